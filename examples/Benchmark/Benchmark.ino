@@ -0,0 +1,204 @@
+#include <SoftWire.h>
+#include <SoftWireSim.h>
+#include <AsyncDelay.h>
+
+/* Benchmark
+ *
+ * Measure the performance of SoftWire for representative workloads on
+ * the simulated bus. No hardware needs to be connected. For each
+ * workload the sketch reports:
+ *
+ *   us/trans     CPU time per transaction, with the delay set to zero
+ *   bytes/s      Bus throughput with the delay set to busDelay_us
+ *   edges/byte   Changes of SDA or SCL per byte
+ *   calls/byte   Line driver (function pointer) calls per byte
+ *   checks/byte  Timeout checks per byte
+ *
+ * Bytes include address bytes. Timeout checks are only made whilst a
+ * slave stretches the clock, and are only counted when the library is
+ * compiled with SOFTWIRE_STATS set to 1.
+ */
+
+const uint16_t iterations = 100;
+const uint8_t busDelay_us = 5;
+
+const uint8_t sensorAddress = 0x40;
+const uint8_t eepromAddress = 0x50;
+const uint8_t eepromPageSize = 16;
+
+uint8_t sensorRegisters[32];
+uint8_t eepromMemory[256];
+
+SoftWireSim bus;
+SoftWireSimRegisters sensor(sensorAddress, sensorRegisters, sizeof(sensorRegisters));
+// No write cycle time, so that page writes can be repeated immediately
+SoftWireSimEeprom eeprom(eepromAddress, eepromMemory, sizeof(eepromMemory),
+						 eepromPageSize, 1, 0);
+
+SoftWire sw(0, 0);
+uint8_t page[eepromPageSize + 1]; // Memory address and data
+// The same page, sent from the caller's memory without a TX buffer
+const SoftWire::span_t pageSpans[] = {
+	{page, 1},
+	{page + 1, eepromPageSize},
+};
+uint8_t txBuffer[eepromPageSize + 1];
+uint8_t rxBuffer[eepromPageSize];
+
+
+void registerRead(void)
+{
+	uint8_t reg = 0;
+	uint8_t data[2];
+	sw.readRegister(sensorAddress, &reg, 1, data, sizeof(data));
+}
+
+
+// The sensor holds SCL low after each byte it acknowledges
+void registerReadStretched(void)
+{
+	sensor.setStretch(4);
+	registerRead();
+	sensor.setStretch(0);
+}
+
+
+void registerReadWire(void)
+{
+	sw.beginTransmission(sensorAddress);
+	sw.write(uint8_t(0));
+	sw.endTransmission();
+	sw.requestFrom(sensorAddress, uint8_t(2));
+}
+
+
+void eepromPageWrite(void)
+{
+	sw.beginTransmission(eepromAddress);
+	sw.write(page, sizeof(page));
+	sw.endTransmission();
+}
+
+
+void eepromPageWriteSpans(void)
+{
+	sw.beginTransmission(eepromAddress, pageSpans, 2);
+	sw.endTransmission();
+}
+
+
+void eepromPageRead(void)
+{
+	uint8_t memAddress = 0;
+	sw.readRegister(eepromAddress, &memAddress, 1, rxBuffer, sizeof(rxBuffer));
+}
+
+
+void addressScan(void)
+{
+	uint8_t bitmap[16];
+	sw.scan(bitmap);
+}
+
+
+struct workload_t {
+	const char *name;
+	void (*run)(void);
+};
+
+const workload_t workloads[] = {
+	{"Register read        ", registerRead},
+	{"Register read (Wire) ", registerReadWire},
+	{"Register read (slow) ", registerReadStretched},
+	{"EEPROM page write    ", eepromPageWrite},
+	{"EEPROM write (spans) ", eepromPageWriteSpans},
+	{"EEPROM page read     ", eepromPageRead},
+	{"Address scan         ", addressScan},
+};
+
+
+unsigned long timeWorkload(const workload_t &workload, uint8_t delay_us)
+{
+	sw.setDelay_us(delay_us);
+	bus.resetStats();
+#if SOFTWIRE_STATS
+	sw.resetTimeoutChecks();
+#endif
+	unsigned long startTime = micros();
+	for (uint16_t i = 0; i < iterations; ++i)
+		(*workload.run)();
+	return micros() - startTime;
+}
+
+
+void printPerByte(uint32_t count, uint32_t bytes)
+{
+	Serial.print("  ");
+	Serial.print(float(count) / bytes);
+}
+
+
+void benchmark(const workload_t &workload)
+{
+	// Bus throughput with a realistic delay
+	unsigned long busTime = timeWorkload(workload, busDelay_us);
+
+	// CPU cost, and line statistics, with no delay
+	unsigned long cpuTime = timeWorkload(workload, 0);
+	const SoftWireSim::stats_t &stats = bus.getStats();
+	uint32_t bytes = stats.bytes + stats.starts; // Every start has an address
+	uint32_t calls = stats.sdaLow + stats.sdaHigh + stats.sclLow + stats.sclHigh
+		+ stats.readSda + stats.readScl;
+
+	Serial.print(workload.name);
+	Serial.print("  ");
+	Serial.print(float(cpuTime) / iterations);
+	Serial.print("  ");
+	Serial.print(busTime ? (1000000.0 * bytes) / busTime : 0.0);
+	printPerByte(stats.edges, bytes);
+	printPerByte(calls, bytes);
+#if SOFTWIRE_STATS
+	printPerByte(sw.getTimeoutChecks(), bytes);
+#else
+	Serial.print("  -");
+#endif
+	Serial.println();
+}
+
+
+void setup(void)
+{
+	Serial.begin(9600);
+	Serial.println("Benchmark");
+
+	for (uint8_t i = 0; i < sizeof(page); ++i)
+		page[i] = i;
+	page[0] = 0; // Memory address
+
+	bus.addDevice(sensor);
+	bus.addDevice(eeprom);
+	bus.attach(sw);
+	sw.setTxBuffer(txBuffer, sizeof(txBuffer));
+	sw.setRxBuffer(rxBuffer, sizeof(rxBuffer));
+	sw.begin();
+
+	sw.calibrate();
+	Serial.print("Line driver overhead: ");
+	Serial.print(sw.getOverhead_ns());
+	Serial.println(" ns per half-bit");
+
+	Serial.print("Iterations: ");
+	Serial.print(iterations);
+	Serial.print(", bus delay: ");
+	Serial.print(busDelay_us);
+	Serial.println(" us");
+	Serial.println("Workload               us/trans  bytes/s  edges/byte  calls/byte  checks/byte");
+	for (uint8_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i)
+		benchmark(workloads[i]);
+}
+
+
+void loop(void)
+{
+	;
+}
@@ -0,0 +1,67 @@
+#include <SoftWire.h>
+#include <AsyncDelay.h>
+
+/* CRC8_Benchmark
+ *
+ * Compare the throughput of the CRC-8 implementations used for the
+ * SMBus PEC: the bitwise loop, the 16-entry nibble table and the
+ * 256-entry table. The implementation used by SoftWire::crc8_update()
+ * is selected at compile-time with SOFTWIRE_CRC8_TABLE_SIZE.
+ *
+ * No hardware needs to be connected.
+ */
+
+const uint16_t numBytes = 4096;
+// Each implementation is repeated for at least this long, so that fast
+// implementations are timed accurately
+const unsigned long minTime_us = 200000UL;
+
+
+void benchmark(const char *name, uint8_t (*update)(uint8_t, uint8_t), uint8_t &result)
+{
+	uint8_t crc;
+	uint32_t bytes = 0;
+	unsigned long elapsed;
+	unsigned long startTime = micros();
+	do {
+		crc = 0;
+		for (uint16_t i = 0; i < numBytes; ++i)
+			crc = (*update)(crc, uint8_t(i));
+		bytes += numBytes;
+		elapsed = micros() - startTime;
+	} while (elapsed < minTime_us);
+
+	Serial.print(name);
+	Serial.print(": ");
+	Serial.print((1000.0 * elapsed) / bytes);
+	Serial.print(" ns per byte, ");
+	Serial.print((1000000.0 * bytes) / elapsed, 0);
+	Serial.print(" bytes/s, CRC 0x");
+	Serial.println(crc, HEX);
+	result = crc;
+}
+
+
+void setup(void)
+{
+	Serial.begin(9600);
+	Serial.println("CRC8_Benchmark");
+	Serial.print("SOFTWIRE_CRC8_TABLE_SIZE: ");
+	Serial.println(SOFTWIRE_CRC8_TABLE_SIZE);
+
+	uint8_t loopCrc, nibbleCrc, tableCrc;
+	benchmark("Bitwise loop  ", SoftWire::crc8_updateLoop, loopCrc);
+	benchmark("Nibble table  ", SoftWire::crc8_updateNibble, nibbleCrc);
+	benchmark("256-byte table", SoftWire::crc8_updateTable, tableCrc);
+
+	if (loopCrc == nibbleCrc && loopCrc == tableCrc)
+		Serial.println("All implementations agree");
+	else
+		Serial.println("ERROR: implementations disagree");
+}
+
+
+void loop(void)
+{
+	;
+}
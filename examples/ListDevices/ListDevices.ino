@@ -29,22 +29,20 @@ void setup(void)
 	Serial.print(lastAddr, HEX);
 	Serial.println(" (inclusive) ...");
 
-	for (uint8_t addr = firstAddr; addr <= lastAddr; addr++) {
-		digitalWrite(LED_BUILTIN, HIGH);
-		delayMicroseconds(50);
-
-		uint8_t startResult = sw.llStart((addr << 1) + 1); // Signal a read
-		sw.stop();
+	// One bit per address
+	uint8_t bitmap[16];
+	digitalWrite(LED_BUILTIN, HIGH);
+	SoftWire::result_t r = sw.scan(bitmap, firstAddr, lastAddr);
+	digitalWrite(LED_BUILTIN, LOW);
 
-		if (startResult == 0) {
-			Serial.print("\rDevice found at 0x");
+	for (uint8_t addr = firstAddr; addr <= lastAddr; addr++) {
+		if (bitmap[addr >> 3] & (1 << (addr & 7))) {
+			Serial.print("Device found at 0x");
 			Serial.println(addr, HEX);
-			Serial.flush();
 		}
-		digitalWrite(LED_BUILTIN, LOW);
-
-		delay(50);
 	}
+	if (r == SoftWire::timedOut)
+		Serial.println("Scan abandoned, SCL held low");
 	Serial.println("Finished");
 
 }
@@ -0,0 +1,87 @@
+#include <SoftWire.h>
+#include <SoftWireSim.h>
+#include <AsyncDelay.h>
+
+/* SimulatedBus
+ *
+ * Demonstrate the simulated I2C bus. A register-file sensor, an EEPROM
+ * and an SMBus device are connected to a simulated bus, and SoftWire
+ * communicates with them exactly as it would with real devices. The
+ * number of line operations for each transaction is printed.
+ *
+ * No hardware needs to be connected.
+ */
+
+uint8_t sensorRegisters[32];
+uint8_t eepromMemory[256];
+uint16_t smbusWords[32];
+
+SoftWireSim bus;
+SoftWireSimRegisters sensor(0x40, sensorRegisters, sizeof(sensorRegisters));
+SoftWireSimEeprom eeprom(0x50, eepromMemory, sizeof(eepromMemory), 16, 1);
+SoftWireSimSmBus smbusDevice(0x5A, smbusWords, 32);
+
+// The pin numbers are not used by the simulated bus
+SoftWire sw(0, 0);
+
+
+void printStats(const char *name, SoftWire::result_t result)
+{
+	const SoftWireSim::stats_t &stats = bus.getStats();
+	Serial.print(name);
+	Serial.print(": result ");
+	Serial.print(result);
+	Serial.print(", ");
+	Serial.print(stats.bytes);
+	Serial.print(" bytes, ");
+	Serial.print(stats.edges);
+	Serial.print(" edges, ");
+	Serial.print(stats.sdaLow + stats.sdaHigh + stats.sclLow + stats.sclHigh
+				 + stats.readSda + stats.readScl);
+	Serial.println(" line driver calls");
+	bus.resetStats();
+}
+
+
+void setup(void)
+{
+	Serial.begin(9600);
+	Serial.println("SimulatedBus");
+
+	for (uint8_t i = 0; i < sizeof(sensorRegisters); ++i)
+		sensorRegisters[i] = i;
+	smbusWords[7] = 0x3AB4;
+
+	// Simulate a slow sensor which stretches the clock
+	sensor.setStretch(10);
+
+	bus.addDevice(sensor);
+	bus.addDevice(eeprom);
+	bus.addDevice(smbusDevice);
+	bus.attach(sw);
+	sw.setDelay_us(0);
+	sw.begin();
+	bus.resetStats();
+
+	uint8_t reg = 4;
+	uint8_t data[4];
+	printStats("Sensor read", sw.readRegister(0x40, &reg, 1, data, sizeof(data)));
+
+	uint8_t eepromAddress = 0x10;
+	const uint8_t message[] = "SoftWire";
+	printStats("EEPROM write", sw.writeRegister(0x50, &eepromAddress, 1, message, sizeof(message)));
+
+	sw.enablePec();
+	uint8_t command = 7;
+	uint8_t word[3];
+	SoftWire::result_t result = sw.readRegister(0x5A, &command, 1, word, sizeof(word));
+	printStats("SMBus read word", result);
+	Serial.print("PEC ");
+	Serial.println(sw.getPec() == 0 ? "valid" : "invalid");
+}
+
+
+void loop(void)
+{
+	;
+}
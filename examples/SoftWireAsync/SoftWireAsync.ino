@@ -0,0 +1,75 @@
+#include <SoftWire.h>
+#include <SoftWireAsync.h>
+#include <AsyncDelay.h>
+
+/* SoftWireAsync
+ *
+ * Read two bytes from register 0 of a device without blocking the main
+ * loop. The transaction is advanced by calling poll() from loop(); the
+ * LED continues to flash whilst the transaction is in progress.
+ *
+ * Adjust sdaPin, sclPin and address to suit your hardware.
+ */
+
+#if defined(ARDUINO_ARCH_AVR)
+uint8_t sdaPin = A4;
+uint8_t sclPin = A5;
+#else
+uint8_t sdaPin = 0;
+uint8_t sclPin = 1;
+#endif
+
+const uint8_t address = 0x50;
+
+SoftWire sw(sdaPin, sclPin);
+SoftWireAsync swAsync(sw);
+
+uint8_t reg = 0;
+uint8_t rxBuffer[2];
+
+AsyncDelay samplingInterval;
+AsyncDelay flashInterval;
+
+
+void transactionComplete(SoftWireAsync *p, SoftWire::result_t result)
+{
+	if (result == SoftWire::ack) {
+		Serial.print("Data: 0x");
+		Serial.print(rxBuffer[0], HEX);
+		Serial.print(" 0x");
+		Serial.println(rxBuffer[1], HEX);
+	}
+	else {
+		Serial.print("Transaction failed: ");
+		Serial.println(result == SoftWire::nack ? "NACK" : "timeout");
+	}
+}
+
+
+void setup(void)
+{
+	Serial.begin(9600);
+	Serial.println("SoftWireAsync");
+	pinMode(LED_BUILTIN, OUTPUT);
+
+	sw.begin();
+	swAsync.setCallback(transactionComplete);
+	samplingInterval.start(1000, AsyncDelay::MILLIS);
+	flashInterval.start(100, AsyncDelay::MILLIS);
+}
+
+
+void loop(void)
+{
+	swAsync.poll();
+
+	if (samplingInterval.isExpired() && !swAsync.busy()) {
+		swAsync.submit(address, &reg, 1, rxBuffer, sizeof(rxBuffer));
+		samplingInterval.repeat();
+	}
+
+	if (flashInterval.isExpired()) {
+		digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
+		flashInterval.repeat();
+	}
+}
@@ -0,0 +1,76 @@
+#include <SoftWire.h>
+#include <SoftWireEeprom.h>
+#include <AsyncDelay.h>
+
+/* SoftWireEeprom
+ *
+ * Write a block of data which spans several pages to a 24LC256 EEPROM
+ * (32 kB, 64 byte pages, 2 address bytes), then read it back in one
+ * transaction and compare. The write cycle of each page is found by
+ * acknowledge polling so no fixed delays are needed.
+ *
+ * Adjust sdaPin, sclPin and the EEPROM geometry to suit your hardware.
+ */
+
+#if defined(ARDUINO_ARCH_AVR)
+uint8_t sdaPin = A4;
+uint8_t sclPin = A5;
+#else
+uint8_t sdaPin = 0;
+uint8_t sclPin = 1;
+#endif
+
+const uint8_t address = 0x50;
+const uint32_t memAddr = 100; // Not aligned to a page
+
+SoftWire sw(sdaPin, sclPin);
+SoftWireEeprom eeprom(sw, address, 32768UL, 64, 2);
+
+uint8_t data[200];
+uint8_t readBack[sizeof(data)];
+
+
+void setup(void)
+{
+	Serial.begin(9600);
+	Serial.println("SoftWireEeprom");
+
+	sw.setClock(400000);
+	sw.begin();
+
+	for (uint16_t i = 0; i < sizeof(data); ++i)
+		data[i] = i;
+
+	unsigned long start = micros();
+	SoftWire::result_t r = eeprom.write(memAddr, data, sizeof(data));
+	if (r == SoftWire::ack)
+		r = eeprom.waitForWrite();
+	unsigned long writeTime = micros() - start;
+	if (r != SoftWire::ack) {
+		Serial.println("Write failed");
+		return;
+	}
+
+	start = micros();
+	r = eeprom.read(memAddr, readBack, sizeof(readBack));
+	unsigned long readTime = micros() - start;
+	if (r != SoftWire::ack) {
+		Serial.println("Read failed");
+		return;
+	}
+
+	Serial.print("Wrote ");
+	Serial.print(sizeof(data));
+	Serial.print(" bytes in ");
+	Serial.print(writeTime);
+	Serial.print(" us, read in ");
+	Serial.print(readTime);
+	Serial.println(" us");
+	Serial.println(memcmp(data, readBack, sizeof(data)) ? "Data differs" : "Data matches");
+}
+
+
+void loop(void)
+{
+	;
+}
@@ -0,0 +1,172 @@
+#include <SoftWire.h>
+#include <SoftWireT.h>
+#include <AsyncDelay.h>
+
+/* SoftWireT_Benchmark
+ *
+ * Compare the cost of the run-time configured SoftWire class against
+ * the compile-time specialised SoftWireT template. Both drive the same
+ * simulated bus held in memory, so no hardware needs to be connected
+ * and the measurement is of CPU time only. For each variant the sketch
+ * reports the number of line edges and the time taken per transaction.
+ *
+ * SoftWire's direct port access line drivers are also measured, using
+ * ordinary variables in place of the port registers. The mock input
+ * register always reads high, so edges cannot be counted for this
+ * variant.
+ *
+ * The simulated bus has no slave devices; every byte is NACKed, which
+ * does not alter the number of edges generated.
+ */
+
+const uint8_t simSdaPin = 0;
+const uint8_t simSclPin = 1;
+const uint16_t iterations = 1000;
+const uint8_t payloadLength = 4;
+
+// State of the simulated SDA and SCL lines, released lines read as HIGH
+volatile uint8_t simLine[2] = {HIGH, HIGH};
+uint32_t simEdges = 0;
+
+
+inline void simDrive(uint8_t pin, uint8_t level)
+{
+	if (simLine[pin] != level) {
+		simLine[pin] = level;
+		++simEdges;
+	}
+}
+
+
+// Line drivers for SoftWire
+void simSdaLow(const SoftWire * /* p */)
+{
+	simDrive(simSdaPin, LOW);
+}
+
+
+void simSdaHigh(const SoftWire * /* p */)
+{
+	simDrive(simSdaPin, HIGH);
+}
+
+
+void simSclLow(const SoftWire * /* p */)
+{
+	simDrive(simSclPin, LOW);
+}
+
+
+void simSclHigh(const SoftWire * /* p */)
+{
+	simDrive(simSclPin, HIGH);
+}
+
+
+uint8_t simReadSda(const SoftWire * /* p */)
+{
+	return simLine[simSdaPin];
+}
+
+
+uint8_t simReadScl(const SoftWire * /* p */)
+{
+	return simLine[simSclPin];
+}
+
+
+// Backend for SoftWireT
+class SimBackend {
+public:
+	template <uint8_t pin> static inline void low(void) {
+		simDrive(pin, LOW);
+	}
+	template <uint8_t pin> static inline void release(void) {
+		simDrive(pin, HIGH);
+	}
+	template <uint8_t pin> static inline uint8_t read(void) {
+		return simLine[pin];
+	}
+};
+
+
+// Mock port registers for direct port access
+SoftWire::portValue_t mockMode = 0;
+SoftWire::portValue_t mockOutput = 0;
+SoftWire::portValue_t mockInput = ~SoftWire::portValue_t(0);
+
+
+SoftWire sw(simSdaPin, simSclPin);
+SoftWire swDirect(simSdaPin, simSclPin);
+SoftWireT<simSdaPin, simSclPin, SimBackend> swt;
+
+const uint8_t payload[payloadLength] = {0x00, 0x55, 0xAA, 0xFF};
+
+
+template <class T> void transaction(const T &bus)
+{
+	bus.startWrite(0x50);
+	for (uint8_t i = 0; i < payloadLength; ++i)
+		bus.llWrite(payload[i]);
+	bus.stop();
+}
+
+
+template <class T> void benchmark(const char *name, const T &bus)
+{
+	simEdges = 0;
+	unsigned long startTime = micros();
+	for (uint16_t i = 0; i < iterations; ++i)
+		transaction(bus);
+	unsigned long elapsed = micros() - startTime;
+
+	Serial.print(name);
+	Serial.print(": ");
+	if (simEdges) {
+		Serial.print(simEdges / iterations);
+		Serial.print(" edges, ");
+	}
+	Serial.print(float(elapsed) / iterations);
+	Serial.println(" us per transaction");
+}
+
+
+void setup(void)
+{
+	Serial.begin(9600);
+	Serial.println("SoftWireT_Benchmark");
+
+	sw.setSetSdaLow(simSdaLow);
+	sw.setSetSdaHigh(simSdaHigh);
+	sw.setSetSclLow(simSclLow);
+	sw.setSetSclHigh(simSclHigh);
+	sw.setReadSda(simReadSda);
+	sw.setReadScl(simReadScl);
+
+	swDirect.setSdaPort(&mockMode, &mockOutput, &mockInput, 0x01);
+	swDirect.setSclPort(&mockMode, &mockOutput, &mockInput, 0x02);
+
+	// Measure the bit-banging overhead, not the configured bus speed
+	sw.setDelay_us(0);
+	swDirect.setDelay_us(0);
+	swt.setDelay_us(0);
+
+	sw.begin();
+	swDirect.begin();
+	swt.begin();
+
+	Serial.print("Start, address, ");
+	Serial.print(payloadLength);
+	Serial.print(" data bytes and stop, averaged over ");
+	Serial.print(iterations);
+	Serial.println(" transactions");
+	benchmark("SoftWire           ", sw);
+	benchmark("SoftWire (direct)  ", swDirect);
+	benchmark("SoftWireT          ", swt);
+}
+
+
+void loop(void)
+{
+	;
+}
@@ -0,0 +1,124 @@
+#include <SoftWire.h>
+#include <SoftWireAsync.h>
+#include <SoftWireTimer.h>
+#include <AsyncDelay.h>
+
+/* SoftWireTimer
+ *
+ * Read two bytes from register 0 of a device in the background. Each
+ * half-bit of the transaction is clocked out from a timer interrupt, so
+ * loop() runs concurrently without calling poll().
+ *
+ * On AVR microcontrollers with Timer1 the timer interrupt is used. On
+ * other architectures SoftWireManualTimer is fired from loop() instead;
+ * replace it with a SoftWireTimer implementation for your hardware.
+ *
+ * Adjust sdaPin, sclPin and address to suit your hardware.
+ */
+
+#if defined(ARDUINO_ARCH_AVR)
+uint8_t sdaPin = A4;
+uint8_t sclPin = A5;
+#else
+uint8_t sdaPin = 0;
+uint8_t sclPin = 1;
+#endif
+
+const uint8_t address = 0x50;
+
+
+#if defined(ARDUINO_ARCH_AVR) && defined(TCCR1A)
+// Timer1 in CTC mode, prescaler 8
+class Timer1 : public SoftWireTimer {
+public:
+	virtual void start(uint16_t period_us, handler_t handler, void *context) {
+		uint32_t counts = (F_CPU / 8000000UL) * period_us;
+		noInterrupts();
+		Timer1::handler = handler;
+		Timer1::context = context;
+		TCCR1A = 0;
+		TCCR1B = _BV(WGM12) | _BV(CS11);
+		OCR1A = (counts > 1 ? counts - 1 : 1);
+		TCNT1 = 0;
+		TIMSK1 |= _BV(OCIE1A);
+		interrupts();
+	}
+
+	virtual void stop(void) {
+		TIMSK1 &= ~_BV(OCIE1A);
+		TCCR1B = 0;
+	}
+
+	static volatile handler_t handler;
+	static void * volatile context;
+};
+
+volatile SoftWireTimer::handler_t Timer1::handler = NULL;
+void * volatile Timer1::context = NULL;
+
+ISR(TIMER1_COMPA_vect)
+{
+	if (Timer1::handler)
+		(*Timer1::handler)(Timer1::context);
+}
+
+Timer1 timer;
+#else
+SoftWireManualTimer timer;
+#endif
+
+
+SoftWire sw(sdaPin, sclPin);
+SoftWireAsync swAsync(sw);
+
+uint8_t reg = 0;
+uint8_t rxBuffer[2];
+volatile bool dataReady = false;
+
+AsyncDelay samplingInterval;
+
+
+// Called from the timer interrupt, so keep it short
+void transactionComplete(SoftWireAsync *p, SoftWire::result_t result)
+{
+	dataReady = true;
+}
+
+
+void setup(void)
+{
+	Serial.begin(9600);
+	Serial.println("SoftWireTimer");
+
+	// The line drivers must complete well within each timer period
+	sw.setDelay_us(20);
+	sw.begin();
+	swAsync.setTimer(&timer);
+	swAsync.setCallback(transactionComplete);
+	samplingInterval.start(1000, AsyncDelay::MILLIS);
+}
+
+
+void loop(void)
+{
+#if !(defined(ARDUINO_ARCH_AVR) && defined(TCCR1A))
+	timer.fire();
+#endif
+
+	if (samplingInterval.isExpired() && !swAsync.busy()) {
+		swAsync.submit(address, &reg, 1, rxBuffer, sizeof(rxBuffer));
+		samplingInterval.repeat();
+	}
+
+	if (dataReady) {
+		dataReady = false;
+		if (swAsync.getResult() == SoftWire::ack) {
+			Serial.print("Data: 0x");
+			Serial.print(rxBuffer[0], HEX);
+			Serial.print(" 0x");
+			Serial.println(rxBuffer[1], HEX);
+		}
+		else
+			Serial.println("Transaction failed");
+	}
+}
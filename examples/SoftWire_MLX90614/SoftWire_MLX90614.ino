@@ -1,5 +1,6 @@
 #include <AsyncDelay.h>
 #include <SoftWire.h>
+#include <SoftWireSmBus.h>
 
 /* SoftWire_MLX90614
  *
@@ -40,6 +41,7 @@ const uint8_t cmdSleep = 0xff;
 
 
 SoftWire i2c(sdaPin, sclPin);
+SoftWireSmBus mlx90614(i2c, 0x5A, true); // With PEC
 
 AsyncDelay samplingInterval;
 
@@ -55,47 +57,25 @@ float convertToDegC(uint16_t data)
 void exitPWM(void)
 {
 	// Make SMBus request to force SMBus output instead of PWM
-	SoftWire::setSclLow(&i2c);
+	SoftWire::sclLow(&i2c);
 	delay(3); // Must be > 1.44ms
-	SoftWire::setSclHigh(&i2c);
+	SoftWire::sclHigh(&i2c);
 	delay(2);
 }
 
 
-uint16_t readMLX90614(uint8_t command, uint8_t &crc)
+uint16_t readMLX90614(uint8_t command, SoftWireSmBus::status_t &status)
 {
-	uint8_t address = 0x5A;
-	uint8_t dataLow = 0;
-	uint8_t dataHigh = 0;
-	uint8_t pec = 0;
+	uint16_t data;
 
-	uint8_t errors = 0;
 	digitalWrite(LED_BUILTIN, HIGH); delayMicroseconds(50);
-	// Send command
-	errors += i2c.startWait(address, SoftWire::writeMode);
-	errors += i2c.write(command);
-
-	// Read results
-	errors += i2c.repeatedStart(address, SoftWire::readMode);
-	errors += i2c.readThenAck(dataLow);  // Read 1 byte and then send ack
-	errors += i2c.readThenAck(dataHigh); // Read 1 byte and then send ack
-	errors += i2c.readThenNack(pec);
-	i2c.stop();
+	// Read Word protocol. The PEC is checked as the data is received.
+	status = mlx90614.readWord(command, data);
 	digitalWrite(LED_BUILTIN, LOW);
 
-	crc = 0;
-	crc = SoftWire::crc8_update(crc, address << 1); // Write address
-	crc = SoftWire::crc8_update(crc, command);
-	crc = SoftWire::crc8_update(crc, (address << 1) + 1); // Read address
-	crc = SoftWire::crc8_update(crc, dataLow);
-	crc = SoftWire::crc8_update(crc, dataHigh);
-	crc = SoftWire::crc8_update(pec, pec);
-
-	if (errors) {
-		crc = 0xFF;
+	if (status != SoftWireSmBus::ok)
 		return 0xFFFF;
-	}
-	return (uint16_t(dataHigh) << 8) | dataLow;
+	return data;
 }
 
 
@@ -139,16 +119,16 @@ void loop(void)
 	exitPWM();
 #endif
 
-	uint8_t crcAmbient;
-	uint16_t rawAmbient = readMLX90614(cmdAmbient, crcAmbient);
-	uint8_t crcObject1;
-	uint16_t rawObject1 = readMLX90614(cmdObject1, crcObject1);
+	SoftWireSmBus::status_t statusAmbient;
+	uint16_t rawAmbient = readMLX90614(cmdAmbient, statusAmbient);
+	SoftWireSmBus::status_t statusObject1;
+	uint16_t rawObject1 = readMLX90614(cmdObject1, statusObject1);
 	// Uncomment lines below for dual FoV sensors
-	// uint8_t crcObject2;
-	// uint16_t rawObject2 = readMLX90614(cmdObject2, crcObject2);
+	// SoftWireSmBus::status_t statusObject2;
+	// uint16_t rawObject2 = readMLX90614(cmdObject2, statusObject2);
 
 	Serial.print("Ambient: ");
-	if (crcAmbient)
+	if (statusAmbient)
 		Serial.print("bus error");
 	else if (rawAmbient & 0x8000)
 		Serial.print("read error");
@@ -156,7 +136,7 @@ void loop(void)
 		Serial.print(convertToDegC(rawAmbient));
 
 	Serial.print("    Object 1: ");
-	if (crcObject1)
+	if (statusObject1)
 		Serial.print("bus error");
 	else if (rawObject1 & 0x8000)
 		Serial.print("read error");
@@ -167,7 +147,7 @@ void loop(void)
 	// Serial.print("    Object 2: ");
 	// if (rawObject2 & 0x8000)
 	//   Serial.print("read error");
-	// else if (crcObject2)
+	// else if (statusObject2)
 	//   Serial.print("bus error");
 	// else
 	//   Serial.print(convertToDegC(rawObject2));
@@ -0,0 +1,16 @@
+// Entry point for running a sketch on the host: setup() is called once,
+// followed by a single call to loop().
+
+#include <Arduino.h>
+
+void setup(void);
+void loop(void);
+
+
+int main(void)
+{
+	setup();
+	loop();
+	Serial.flush();
+	return 0;
+}
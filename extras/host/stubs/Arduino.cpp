@@ -0,0 +1,180 @@
+#include <Arduino.h>
+#include <time.h>
+
+#ifndef HOST_REAL_CLOCK
+#define HOST_REAL_CLOCK 0
+#endif
+
+
+unsigned long hostMicros = 0;
+void (*hostHook)(void) = NULL;
+void (*hostPinMode)(uint8_t pin, uint8_t mode) = NULL;
+void (*hostDigitalWrite)(uint8_t pin, uint8_t val) = NULL;
+int (*hostDigitalRead)(uint8_t pin) = NULL;
+
+volatile uint8_t hostPortMode[NUM_DIGITAL_PINS / 8];
+volatile uint8_t hostPortOutput[NUM_DIGITAL_PINS / 8];
+volatile uint8_t hostPortInput[NUM_DIGITAL_PINS / 8];
+
+HardwareSerial Serial;
+
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if (hostPinMode)
+		(*hostPinMode)(pin, mode);
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	if (hostDigitalWrite)
+		(*hostDigitalWrite)(pin, val);
+}
+
+
+int digitalRead(uint8_t pin)
+{
+	return (hostDigitalRead ? (*hostDigitalRead)(pin) : HIGH);
+}
+
+
+#if HOST_REAL_CLOCK
+unsigned long micros(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	hostMicros = ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+	if (hostHook)
+		(*hostHook)();
+	return hostMicros;
+}
+
+
+void delayMicroseconds(unsigned int us)
+{
+	// As on AVR, a zero delay returns at once
+	if (us == 0)
+		return;
+	unsigned long start = micros();
+	while (micros() - start < us)
+		;
+}
+
+
+void delay(unsigned long ms)
+{
+	unsigned long start = micros();
+	while (micros() - start < ms * 1000)
+		;
+}
+
+#else
+unsigned long micros(void)
+{
+	if (hostHook)
+		(*hostHook)();
+	return hostMicros++;
+}
+
+
+void delayMicroseconds(unsigned int us)
+{
+	if (hostHook)
+		(*hostHook)();
+	hostMicros += us;
+}
+
+
+void delay(unsigned long ms)
+{
+	if (hostHook)
+		(*hostHook)();
+	hostMicros += ms * 1000;
+}
+#endif
+
+
+unsigned long millis(void)
+{
+	return micros() / 1000;
+}
+
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+	size_t n = 0;
+	while (size--)
+		n += write(*buffer++);
+	return n;
+}
+
+
+size_t Print::print(const char *str)
+{
+	return write(str);
+}
+
+
+size_t Print::print(char c)
+{
+	return write(uint8_t(c));
+}
+
+
+size_t Print::print(long n, int base)
+{
+	if (n < 0 && base == DEC)
+		return print('-') + printNumber(-(unsigned long)n, base);
+	return printNumber(n, base);
+}
+
+
+size_t Print::print(unsigned long n, int base)
+{
+	return printNumber(n, base);
+}
+
+
+size_t Print::print(double n, int digits)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+	return write(buffer);
+}
+
+
+size_t Print::println(void)
+{
+	return write("\r\n");
+}
+
+
+size_t Print::printNumber(unsigned long n, int base)
+{
+	char buffer[8 * sizeof(n) + 1];
+	char *p = &buffer[sizeof(buffer) - 1];
+	*p = '\0';
+	if (base < 2)
+		base = 10;
+	do {
+		uint8_t digit = n % base;
+		n /= base;
+		*--p = (digit < 10 ? '0' + digit : 'A' + digit - 10);
+	} while (n);
+	return write(p);
+}
+
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	if (c != '\r')
+		putchar(c);
+	return 1;
+}
+
+
+void HardwareSerial::flush(void)
+{
+	fflush(stdout);
+}
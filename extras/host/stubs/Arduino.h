@@ -0,0 +1,166 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Minimal stand-in for the Arduino core, sufficient to build SoftWire
+// and the simulator examples on a host computer. F_CPU is deliberately
+// not defined, so SoftWire delays are made with delayMicroseconds() on
+// the simulated clock.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+
+#define LED_BUILTIN 13
+#define SDA 18
+#define SCL 19
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+
+typedef bool boolean;
+
+// Simulated clock in microseconds. micros() advances it by one on every
+// call so that busy-wait loops terminate; delay() and
+// delayMicroseconds() advance it by the requested time.
+//
+// When compiled with HOST_REAL_CLOCK set to 1, as the examples are, the
+// clock functions use the host's monotonic clock instead and the delays
+// busy-wait, so that times measured by benchmarks are real.
+extern unsigned long hostMicros;
+
+// Called whenever the simulated clock is read or advanced, for tests
+// which model hardware that must be updated as the code runs.
+extern void (*hostHook)(void);
+
+// Pin functions call these if set. Otherwise digitalRead() returns HIGH.
+extern void (*hostPinMode)(uint8_t pin, uint8_t mode);
+extern void (*hostDigitalWrite)(uint8_t pin, uint8_t val);
+extern int (*hostDigitalRead)(uint8_t pin);
+
+// Mock port registers, for testing direct port access. Pin n is bit
+// (n % 8) of port (n / 8). Define ARDUINO_ARCH_MEGAAVR when compiling
+// SoftWire for it to use them.
+#define NUM_DIGITAL_PINS 32
+#define digitalPinToPort(pin) ((pin) / 8)
+#define digitalPinToBitMask(pin) (1 << ((pin) % 8))
+#define portModeRegister(port) (&hostPortMode[port])
+#define portOutputRegister(port) (&hostPortOutput[port])
+#define portInputRegister(port) (&hostPortInput[port])
+extern volatile uint8_t hostPortMode[NUM_DIGITAL_PINS / 8];
+extern volatile uint8_t hostPortOutput[NUM_DIGITAL_PINS / 8];
+extern volatile uint8_t hostPortInput[NUM_DIGITAL_PINS / 8];
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+unsigned long micros(void);
+unsigned long millis(void);
+void delayMicroseconds(unsigned int us);
+void delay(unsigned long ms);
+
+inline void noInterrupts(void) {}
+inline void interrupts(void) {}
+
+
+class Print {
+public:
+	Print(void) : _writeError(0) {}
+	virtual ~Print() {}
+
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	inline size_t write(const char *str) {
+		return write((const uint8_t*)str, strlen(str));
+	}
+
+	inline int getWriteError(void) const {
+		return _writeError;
+	}
+	inline void clearWriteError(void) {
+		_writeError = 0;
+	}
+
+	size_t print(const char *str);
+	size_t print(char c);
+	size_t print(long n, int base = DEC);
+	size_t print(unsigned long n, int base = DEC);
+	size_t print(double n, int digits = 2);
+	inline size_t print(int n, int base = DEC) {
+		return print(long(n), base);
+	}
+	inline size_t print(unsigned int n, int base = DEC) {
+		return print((unsigned long)n, base);
+	}
+	inline size_t print(unsigned char n, int base = DEC) {
+		return print((unsigned long)n, base);
+	}
+
+	size_t println(void);
+	template <class T> size_t println(T value) {
+		size_t n = print(value);
+		return n + println();
+	}
+	template <class T> size_t println(T value, int base) {
+		size_t n = print(value, base);
+		return n + println();
+	}
+
+	virtual void flush(void) {}
+
+protected:
+	inline void setWriteError(int err = 1) {
+		_writeError = err;
+	}
+
+private:
+	int _writeError;
+	size_t printNumber(unsigned long n, int base);
+};
+
+
+class Stream : public Print {
+public:
+	virtual int available(void) = 0;
+	virtual int read(void) = 0;
+	virtual int peek(void) = 0;
+};
+
+
+// Writes to stdout
+class HardwareSerial : public Stream {
+public:
+	inline void begin(unsigned long baud) {
+		(void)baud;
+	}
+	inline operator bool(void) const {
+		return true;
+	}
+	virtual size_t write(uint8_t c);
+	using Print::write;
+	virtual int available(void) {
+		return 0;
+	}
+	virtual int read(void) {
+		return -1;
+	}
+	virtual int peek(void) {
+		return -1;
+	}
+	virtual void flush(void);
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef ASYNCDELAY_H
+#define ASYNCDELAY_H
+
+// Stand-in for the AsyncDelay library, using the simulated clock
+
+#include <Arduino.h>
+
+class AsyncDelay {
+public:
+	enum units_t {
+		MICROS,
+		MILLIS,
+	};
+
+	AsyncDelay(void) : _expires(0), _delay(0), _unit(MILLIS) {}
+	AsyncDelay(unsigned long d, units_t unit) {
+		start(d, unit);
+	}
+
+	inline void start(unsigned long d, units_t unit) {
+		_delay = d;
+		_unit = unit;
+		restart();
+	}
+	inline void restart(void) {
+		_expires = now() + _delay;
+	}
+	inline void repeat(void) {
+		_expires += _delay;
+	}
+	inline void expire(void) {
+		_expires = now();
+	}
+	inline bool isExpired(void) const {
+		return long(now() - _expires) >= 0;
+	}
+	inline unsigned long getExpiry(void) const {
+		return _expires;
+	}
+	inline unsigned long getDelay(void) const {
+		return _delay;
+	}
+	inline units_t getUnit(void) const {
+		return _unit;
+	}
+
+private:
+	unsigned long _expires;
+	unsigned long _delay;
+	units_t _unit;
+
+	inline unsigned long now(void) const {
+		return (_unit == MILLIS ? millis() : micros());
+	}
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef TwoWire_h
+#define TwoWire_h
+
+// Stand-in for the Arduino Wire library. Only the interface which
+// SoftWire overrides is provided; there is no hardware bus.
+
+#include <Arduino.h>
+
+class TwoWire : public Stream {
+public:
+	virtual void begin(void) {}
+	virtual void end(void) {}
+	virtual void setClock(uint32_t frequency) {
+		(void)frequency;
+	}
+	virtual size_t write(uint8_t data) {
+		(void)data;
+		return 0;
+	}
+	using Print::write;
+	virtual int available(void) {
+		return 0;
+	}
+	virtual int read(void) {
+		return -1;
+	}
+	virtual int peek(void) {
+		return -1;
+	}
+};
+
+#endif
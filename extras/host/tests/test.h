@@ -0,0 +1,56 @@
+#ifndef TEST_H
+#define TEST_H
+
+// Minimal assertion macros for the host tests. A failed check is reported
+// and counted, and the test continues. Each test program includes this
+// file once and returns testSummary() from main().
+
+#include <Arduino.h>
+
+static unsigned long testChecks = 0;
+static unsigned long testFailures = 0;
+
+#define CHECK(cond) do {												\
+		++testChecks;													\
+		if (!(cond)) {													\
+			++testFailures;												\
+			fprintf(stderr, "%s:%d: check failed: %s\n",				\
+					__FILE__, __LINE__, #cond);							\
+		}																\
+	} while (0)
+
+#define CHECK_EQUAL(expected, actual) do {								\
+		++testChecks;													\
+		long e_ = long(expected);										\
+		long a_ = long(actual);											\
+		if (e_ != a_) {													\
+			++testFailures;												\
+			fprintf(stderr, "%s:%d: expected %s == %ld, got %ld\n",		\
+					__FILE__, __LINE__, #actual, e_, a_);				\
+		}																\
+	} while (0)
+
+#define CHECK_MEMORY(expected, actual, len) do {						\
+		++testChecks;													\
+		if (memcmp((expected), (actual), (len)) != 0) {					\
+			++testFailures;												\
+			fprintf(stderr, "%s:%d: %s differs from %s\n",				\
+					__FILE__, __LINE__, #actual, #expected);			\
+		}																\
+	} while (0)
+
+#define RUN_TEST(test) do {												\
+		unsigned long failures_ = testFailures;							\
+		test();															\
+		if (testFailures != failures_)									\
+			fprintf(stderr, "FAIL %s\n", #test);						\
+	} while (0)
+
+
+static inline int testSummary(const char *name)
+{
+	printf("%s: %lu checks, %lu failed\n", name, testChecks, testFailures);
+	return (testFailures ? 1 : 0);
+}
+
+#endif
@@ -0,0 +1,235 @@
+// SoftWireAsync on the simulated bus, advanced by tick(), poll() and a
+// manual timer
+
+#include <SoftWire.h>
+#include <SoftWireSim.h>
+#include <SoftWireAsync.h>
+#include <SoftWireTimer.h>
+#include "test.h"
+
+// Far more half-bits than any transaction here needs
+const unsigned long maxSteps = 10000;
+
+uint8_t registers[32];
+
+SoftWireSim bus;
+SoftWireSimRegisters sensor(0x40, registers, sizeof(registers));
+SoftWire sw(0, 0);
+SoftWireAsync async(sw);
+
+unsigned long callbacks;
+SoftWire::result_t callbackResult;
+
+
+static void callback(SoftWireAsync *p, SoftWire::result_t result)
+{
+	(void)p;
+	++callbacks;
+	callbackResult = result;
+}
+
+
+static void setUp(void)
+{
+	for (uint8_t i = 0; i < sizeof(registers); ++i)
+		registers[i] = 0x20 + i;
+	sensor.setStretch(0);
+	callbacks = 0;
+	callbackResult = SoftWire::timedOut;
+	async.setCallback(callback);
+	async.setTimer(NULL);
+	bus.resetStats();
+}
+
+
+// Call tick() until the transaction completes, return the number of calls
+static unsigned long runTicks(void)
+{
+	unsigned long steps = 0;
+	while (async.busy() && steps < maxSteps) {
+		async.tick();
+		++steps;
+	}
+	return steps;
+}
+
+
+static void testReadTick(void)
+{
+	setUp();
+	uint8_t reg = 5;
+	uint8_t data[3];
+	CHECK(async.submit(0x40, &reg, 1, data, sizeof(data)));
+	CHECK(async.busy());
+	CHECK(!async.submit(0x40, &reg, 1, data, sizeof(data)));
+
+	unsigned long steps = runTicks();
+	CHECK(!async.busy());
+	CHECK(steps > 2 * 9 * 5); // Five bytes of two half-bits per bit
+	CHECK_EQUAL(SoftWire::ack, async.getResult());
+	CHECK_MEMORY(&registers[5], data, sizeof(data));
+	CHECK_EQUAL(1, callbacks);
+	CHECK_EQUAL(SoftWire::ack, callbackResult);
+	CHECK_EQUAL(2, bus.getStats().starts);
+	CHECK_EQUAL(1, bus.getStats().stops);
+	CHECK(bus.getSda() == HIGH && bus.getScl() == HIGH);
+}
+
+
+static void testWriteTick(void)
+{
+	setUp();
+	const uint8_t data[] = {12, 0xD1, 0xD2};
+	CHECK(async.submit(0x40, data, sizeof(data)));
+	runTicks();
+	CHECK_EQUAL(SoftWire::ack, async.getResult());
+	CHECK_EQUAL(0xD1, registers[12]);
+	CHECK_EQUAL(0xD2, registers[13]);
+	CHECK_EQUAL(1, bus.getStats().starts);
+	CHECK_EQUAL(1, bus.getStats().stops);
+}
+
+
+static void testNack(void)
+{
+	setUp();
+	uint8_t reg = 0;
+	uint8_t data[2] = {0x55, 0x55};
+	CHECK(async.submit(0x41, &reg, 1, data, sizeof(data)));
+	runTicks();
+	CHECK(!async.busy());
+	CHECK_EQUAL(SoftWire::nack, async.getResult());
+	CHECK_EQUAL(SoftWire::nack, callbackResult);
+	CHECK_EQUAL(0x55, data[0]);
+	CHECK_EQUAL(1, bus.getStats().stops);
+	CHECK(bus.getSda() == HIGH && bus.getScl() == HIGH);
+}
+
+
+// A clock-stretching slave delays the transfer but it still completes
+static void testStretch(void)
+{
+	setUp();
+	sensor.setStretch(5);
+	uint8_t reg = 1;
+	uint8_t data[2];
+	CHECK(async.submit(0x40, &reg, 1, data, sizeof(data)));
+	runTicks();
+	CHECK_EQUAL(SoftWire::ack, async.getResult());
+	CHECK_MEMORY(&registers[1], data, sizeof(data));
+}
+
+
+// A slave which holds SCL low for too long aborts the transaction
+static void testStretchTimeout(void)
+{
+	setUp();
+	sw.setTimeout_us(100);
+	sensor.setStretch(1000);
+	uint8_t reg = 1;
+	uint8_t data[2] = {0x55, 0x55};
+	CHECK(async.submit(0x40, &reg, 1, data, sizeof(data)));
+	unsigned long steps = runTicks();
+	CHECK(!async.busy());
+	CHECK(steps < maxSteps);
+	CHECK_EQUAL(SoftWire::timedOut, async.getResult());
+	CHECK_EQUAL(1, callbacks);
+	CHECK_EQUAL(SoftWire::timedOut, callbackResult);
+	CHECK_EQUAL(0x55, data[0]);
+	CHECK_EQUAL(1, bus.getStats().starts);
+	CHECK_EQUAL(0, bus.getStats().stops); // SCL was still held
+
+	// Usable once the slave releases SCL
+	sensor.setStretch(0);
+	for (unsigned long i = 0; i < maxSteps && bus.getScl() == LOW; ++i)
+		bus.readScl();
+	CHECK(bus.getScl() == HIGH);
+	sw.setTimeout_us(SoftWire::defaultTimeout_ms * 1000UL);
+	CHECK(async.submit(0x40, &reg, 1, data, sizeof(data)));
+	runTicks();
+	CHECK_EQUAL(SoftWire::ack, async.getResult());
+	CHECK_MEMORY(&registers[1], data, sizeof(data));
+	CHECK_EQUAL(SoftWire::ack, sw.readRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK_MEMORY(&registers[1], data, sizeof(data));
+	CHECK(bus.getSda() == HIGH && bus.getScl() == HIGH);
+}
+
+
+// poll() only advances once the SoftWire delay has elapsed
+static void testPoll(void)
+{
+	setUp();
+	uint8_t reg = 0;
+	uint8_t data[4];
+	CHECK(async.submit(0x40, &reg, 1, data, sizeof(data)));
+	unsigned long start = micros();
+	unsigned long polls = 0;
+	while (async.busy() && polls < 100 * maxSteps) {
+		async.poll();
+		++polls;
+	}
+	CHECK(!async.busy());
+	CHECK(polls > 2 * 9 * 7); // Not every call advanced
+	CHECK(micros() - start >= 9 * 7 * sw.getDelay_us()); // Seven bytes
+	CHECK_EQUAL(SoftWire::ack, async.getResult());
+	CHECK_MEMORY(registers, data, sizeof(data));
+}
+
+
+static void testTimer(void)
+{
+	setUp();
+	SoftWireManualTimer timer;
+	async.setTimer(&timer);
+	uint8_t reg = 8;
+	uint8_t data[2];
+	CHECK(!timer.isRunning());
+	CHECK(async.submit(0x40, &reg, 1, data, sizeof(data)));
+	CHECK(timer.isRunning());
+	CHECK(timer.getPeriod_us() > 0);
+
+	unsigned long fires = 0;
+	while (async.busy() && fires < maxSteps) {
+		timer.fire();
+		++fires;
+	}
+	CHECK(!async.busy());
+	CHECK(!timer.isRunning());
+	CHECK_EQUAL(SoftWire::ack, async.getResult());
+	CHECK_MEMORY(&registers[8], data, sizeof(data));
+	CHECK_EQUAL(1, callbacks);
+	async.setTimer(NULL);
+}
+
+
+// A blocking transfer on the same bus afterwards sees the bus idle
+static void testThenBlocking(void)
+{
+	setUp();
+	uint8_t reg = 3;
+	uint8_t data[2];
+	CHECK(async.submit(0x40, &reg, 1, data, sizeof(data)));
+	runTicks();
+	uint8_t blocking[2];
+	CHECK_EQUAL(SoftWire::ack, sw.readRegister(0x40, &reg, 1, blocking, sizeof(blocking)));
+	CHECK_MEMORY(data, blocking, sizeof(data));
+}
+
+
+int main(void)
+{
+	bus.addDevice(sensor);
+	bus.attach(sw);
+	sw.setDelay_us(10);
+	sw.begin();
+
+	RUN_TEST(testReadTick);
+	RUN_TEST(testWriteTick);
+	RUN_TEST(testNack);
+	RUN_TEST(testStretch);
+	RUN_TEST(testStretchTimeout);
+	RUN_TEST(testPoll);
+	RUN_TEST(testTimer);
+	RUN_TEST(testThenBlocking);
+	return testSummary("test_async");
+}
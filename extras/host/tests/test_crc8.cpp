@@ -0,0 +1,48 @@
+// The CRC-8 implementations used for the SMBus PEC must agree for every
+// CRC and data byte
+
+#include <SoftWire.h>
+#include "test.h"
+
+
+static void testAgree(void)
+{
+	unsigned long nibbleErrors = 0;
+	unsigned long tableErrors = 0;
+	unsigned long updateErrors = 0;
+	for (uint16_t crc = 0; crc < 256; ++crc)
+		for (uint16_t data = 0; data < 256; ++data) {
+			uint8_t expected = SoftWire::crc8_updateLoop(crc, data);
+			if (SoftWire::crc8_updateNibble(crc, data) != expected)
+				++nibbleErrors;
+			if (SoftWire::crc8_updateTable(crc, data) != expected)
+				++tableErrors;
+			if (SoftWire::crc8_update(crc, data) != expected)
+				++updateErrors;
+		}
+	CHECK_EQUAL(0, nibbleErrors);
+	CHECK_EQUAL(0, tableErrors);
+	CHECK_EQUAL(0, updateErrors);
+}
+
+
+// CRC-8 with polynomial 0x07, initial value 0: check value 0xF4
+static void testCheckValue(void)
+{
+	const char *check = "123456789";
+	uint8_t crc = 0;
+	for (const char *p = check; *p; ++p)
+		crc = SoftWire::crc8_updateLoop(crc, *p);
+	CHECK_EQUAL(0xF4, crc);
+
+	// Appending the CRC gives zero, as checked for a PEC
+	CHECK_EQUAL(0, SoftWire::crc8_updateLoop(crc, crc));
+}
+
+
+int main(void)
+{
+	RUN_TEST(testAgree);
+	RUN_TEST(testCheckValue);
+	return testSummary("test_crc8");
+}
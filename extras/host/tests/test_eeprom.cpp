@@ -0,0 +1,156 @@
+// SoftWireEeprom on a simulated 24Cxx EEPROM, including acknowledge
+// polling during the write cycle.
+
+#include <SoftWire.h>
+#include <SoftWireSim.h>
+#include <SoftWireEeprom.h>
+#include "test.h"
+
+const uint16_t writeCycle_us = 2000;
+
+uint8_t memory[256];
+uint8_t bigMemory[1024];
+
+SoftWireSim bus;
+SoftWireSimEeprom device(0x50, memory, sizeof(memory), 16, 1, writeCycle_us);
+// 24C08-type device: 8-bit memory address, the upper two bits in the
+// device address
+SoftWireSimEeprom bigDevice0(0x54, &bigMemory[0], 256, 16, 1, writeCycle_us);
+SoftWireSimEeprom bigDevice1(0x55, &bigMemory[256], 256, 16, 1, writeCycle_us);
+SoftWire sw(0, 0);
+SoftWireEeprom eeprom(sw, 0x50, sizeof(memory), 16, 1);
+SoftWireEeprom bigEeprom(sw, 0x54, 512, 16, 1);
+
+
+static void setUp(void)
+{
+	eeprom.waitForWrite();
+	bigEeprom.waitForWrite();
+	memset(memory, 0xFF, sizeof(memory));
+	memset(bigMemory, 0xFF, sizeof(bigMemory));
+	sw.enablePec(false);
+	bus.resetStats();
+}
+
+
+static void testWriteRead(void)
+{
+	setUp();
+	uint8_t data[40];
+	for (uint8_t i = 0; i < sizeof(data); ++i)
+		data[i] = i * 3;
+
+	// 0x0C to 0x33 covers four pages
+	CHECK_EQUAL(SoftWire::ack, eeprom.write(0x0C, data, sizeof(data)));
+	CHECK_MEMORY(data, &memory[0x0C], sizeof(data));
+	CHECK_EQUAL(0xFF, memory[0x0B]);
+	CHECK_EQUAL(0xFF, memory[0x34]);
+	CHECK(eeprom.isWriting());
+	CHECK(device.isBusy());
+
+	// The read polls until the last write cycle has completed
+	uint8_t result[40];
+	unsigned long start = micros();
+	CHECK_EQUAL(SoftWire::ack, eeprom.read(0x0C, result, sizeof(result)));
+	CHECK(micros() - start < 2 * writeCycle_us);
+	CHECK_MEMORY(data, result, sizeof(result));
+	CHECK(!eeprom.isWriting());
+	CHECK(!device.isBusy());
+}
+
+
+static void testWaitForWrite(void)
+{
+	setUp();
+	const uint8_t data[] = {1, 2, 3};
+	CHECK_EQUAL(SoftWire::ack, eeprom.write(0x80, data, sizeof(data)));
+	CHECK(device.isBusy());
+	CHECK_EQUAL(SoftWire::ack, eeprom.waitForWrite());
+	CHECK(!device.isBusy());
+	CHECK(!eeprom.isWriting());
+	CHECK_EQUAL(SoftWire::ack, eeprom.waitForWrite());
+}
+
+
+static void testWriteTimeout(void)
+{
+	setUp();
+	const uint8_t data[] = {1, 2, 3};
+	eeprom.setWriteTimeout_us(writeCycle_us / 4);
+	CHECK_EQUAL(SoftWire::ack, eeprom.write(0x00, data, sizeof(data)));
+	uint8_t result[3];
+	CHECK_EQUAL(SoftWire::nack, eeprom.read(0x00, result, sizeof(result)));
+	CHECK(bus.getSda() == HIGH && bus.getScl() == HIGH);
+	eeprom.setWriteTimeout_us(SoftWireEeprom::defaultWriteTimeout_us);
+	CHECK_EQUAL(SoftWire::ack, eeprom.read(0x00, result, sizeof(result)));
+	CHECK_MEMORY(data, result, sizeof(result));
+}
+
+
+static void testOutOfRange(void)
+{
+	setUp();
+	const uint8_t data[10] = {0};
+	uint8_t result[10];
+	CHECK_EQUAL(SoftWire::nack, eeprom.write(250, data, sizeof(data)));
+	CHECK_EQUAL(SoftWire::nack, eeprom.read(250, result, sizeof(result)));
+	CHECK_EQUAL(0, bus.getStats().starts);
+	CHECK_EQUAL(0xFF, memory[250]);
+}
+
+
+static void testAddressBits(void)
+{
+	setUp();
+	uint8_t data[8];
+	for (uint8_t i = 0; i < sizeof(data); ++i)
+		data[i] = 0xA0 + i;
+
+	// Crosses from the first 256 bytes to the second
+	CHECK_EQUAL(SoftWire::ack, bigEeprom.write(0xFC, data, sizeof(data)));
+	CHECK_MEMORY(&data[0], &bigMemory[0xFC], 4);
+	CHECK_MEMORY(&data[4], &bigMemory[0x100], 4);
+
+	uint8_t result[8];
+	CHECK_EQUAL(SoftWire::ack, bigEeprom.read(0xFC, result, 4));
+	CHECK_EQUAL(SoftWire::ack, bigEeprom.read(0x100, &result[4], 4));
+	CHECK_MEMORY(data, result, sizeof(result));
+}
+
+
+// Acknowledge polls which are not acknowledged must not be added to the
+// PEC, only the address which is
+static void testPollPec(void)
+{
+	setUp();
+	const uint8_t data[] = {7};
+	CHECK_EQUAL(SoftWire::ack, eeprom.write(0x20, data, sizeof(data)));
+	CHECK(device.isBusy());
+
+	sw.enablePec();
+	uint8_t rawAddr = (0x50 << 1) + SoftWire::writeMode;
+	CHECK_EQUAL(SoftWire::ack, sw.llStartPoll(rawAddr, 50, 10000));
+	CHECK_EQUAL(SoftWire::crc8_update(0, rawAddr), sw.getPec());
+	sw.stop();
+	sw.enablePec(false);
+	CHECK(!device.isBusy());
+}
+
+
+int main(void)
+{
+	bus.addDevice(device);
+	bus.addDevice(bigDevice0);
+	bus.addDevice(bigDevice1);
+	bus.attach(sw);
+	sw.setDelay_us(1);
+	sw.begin();
+
+	RUN_TEST(testWriteRead);
+	RUN_TEST(testWaitForWrite);
+	RUN_TEST(testWriteTimeout);
+	RUN_TEST(testOutOfRange);
+	RUN_TEST(testAddressBits);
+	RUN_TEST(testPollPec);
+	return testSummary("test_eeprom");
+}
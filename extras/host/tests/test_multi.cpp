@@ -0,0 +1,234 @@
+// SoftWireMulti driving four simulated buses. The port registers are
+// ordinary variables; the hook called by the simulated clock copies the
+// master's outputs onto each SoftWireSim and their levels back into the
+// input registers.
+
+#include <SoftWire.h>
+#include <SoftWireSim.h>
+#include <SoftWireMulti.h>
+#include "test.h"
+
+const uint8_t numBuses = 4;
+
+SoftWire::portReg_t sdaMode, sdaOutput, sdaInput;
+SoftWire::portReg_t sclMode, sclOutput, sclInput;
+
+SoftWireSim buses[numBuses];
+uint8_t registers[numBuses][16];
+SoftWireSimRegisters sensors[numBuses] = {
+	SoftWireSimRegisters(0x40, registers[0], 16),
+	SoftWireSimRegisters(0x40, registers[1], 16),
+	SoftWireSimRegisters(0x40, registers[2], 16),
+	SoftWireSimRegisters(0x40, registers[3], 16),
+};
+SoftWireMulti multi;
+
+// Bus n uses SDA bit 2n and SCL bit n + 8
+bool sclStuck[numBuses];
+
+
+static inline SoftWire::portValue_t sdaBit(uint8_t n)
+{
+	return SoftWire::portValue_t(1) << (2 * n);
+}
+
+
+static inline SoftWire::portValue_t sclBit(uint8_t n)
+{
+	return SoftWire::portValue_t(1) << (n + 8);
+}
+
+
+static inline uint8_t level(SoftWire::portValue_t mode, SoftWire::portValue_t output,
+							SoftWire::portValue_t mask)
+{
+	return ((mode & mask) && !(output & mask)) ? LOW : HIGH;
+}
+
+
+static void updatePorts(void)
+{
+	SoftWire::portValue_t sda = ~SoftWire::portValue_t(0);
+	SoftWire::portValue_t scl = ~SoftWire::portValue_t(0);
+	for (uint8_t n = 0; n < numBuses; ++n) {
+		// Both lines may have changed since the last update. SoftWireMulti
+		// only changes SDA whilst SCL is low, except for a start or stop
+		// which is followed by a delay, so SCL falls first and rises last.
+		uint8_t sclLevel = level(sclMode, sclOutput, sclBit(n));
+		if (sclLevel == LOW)
+			buses[n].setMasterScl(LOW);
+		buses[n].setMasterSda(level(sdaMode, sdaOutput, sdaBit(n)));
+		buses[n].setMasterScl(sclLevel);
+		if (buses[n].readSda() == LOW)
+			sda &= ~sdaBit(n);
+		if (buses[n].readScl() == LOW || sclStuck[n])
+			scl &= ~sclBit(n);
+	}
+	sdaInput = sda;
+	sclInput = scl;
+}
+
+
+static void setUp(void)
+{
+	for (uint8_t n = 0; n < numBuses; ++n) {
+		for (uint8_t i = 0; i < 16; ++i)
+			registers[n][i] = 0x10 * n + i;
+		sensors[n].setStretch(0);
+		sclStuck[n] = false;
+		buses[n].resetStats();
+	}
+	multi.setDelay_us(1);
+	multi.setTimeout_us(500);
+}
+
+
+static bool allIdle(void)
+{
+	for (uint8_t n = 0; n < numBuses; ++n)
+		if (buses[n].getSda() == LOW || buses[n].getScl() == LOW)
+			return false;
+	return true;
+}
+
+
+static void testReadRegister(void)
+{
+	setUp();
+	uint8_t reg = 6;
+	uint8_t out[numBuses * 3];
+	SoftWireMulti::busMask_t acked = 0;
+	CHECK_EQUAL(SoftWire::ack, multi.readRegister(0x40, &reg, 1, out, 3, acked));
+	CHECK_EQUAL(0xF, acked);
+	for (uint8_t n = 0; n < numBuses; ++n)
+		CHECK_MEMORY(&registers[n][6], &out[n * 3], 3);
+	for (uint8_t n = 0; n < numBuses; ++n) {
+		CHECK_EQUAL(2, buses[n].getStats().starts);
+		CHECK_EQUAL(1, buses[n].getStats().stops);
+	}
+	CHECK(allIdle());
+}
+
+
+// The device on one bus does not acknowledge, the others complete
+static void testPartialNack(void)
+{
+	setUp();
+	uint8_t reg = 2;
+	uint8_t out[numBuses * 2];
+	memset(out, 0, sizeof(out));
+	SoftWireMulti::busMask_t acked = 0;
+	CHECK_EQUAL(SoftWire::nack, multi.readRegister(0x41, &reg, 1, out, 2, acked));
+	CHECK_EQUAL(0, acked);
+
+	// Only bus 2 has a device at 0x41
+	SoftWireSimRegisters other(0x41, registers[2], 16);
+	buses[2].addDevice(other);
+	CHECK_EQUAL(SoftWire::nack, multi.readRegister(0x41, &reg, 1, out, 2, acked));
+	CHECK_EQUAL(0x4, acked);
+	CHECK_MEMORY(&registers[2][2], &out[2 * 2], 2);
+	CHECK(allIdle());
+}
+
+
+static void testWrite(void)
+{
+	setUp();
+	SoftWireMulti::busMask_t acked = 0;
+	const uint8_t values[numBuses] = {0xA0, 0xA1, 0xA2, 0xA3};
+	CHECK_EQUAL(SoftWire::ack, multi.llStart((0x40 << 1) + SoftWire::writeMode, acked));
+	CHECK_EQUAL(0xF, acked);
+	CHECK_EQUAL(SoftWire::ack, multi.llWrite(uint8_t(9), acked));
+	CHECK_EQUAL(SoftWire::ack, multi.llWrite(values, acked));
+	CHECK_EQUAL(0xF, acked);
+	CHECK_EQUAL(SoftWire::ack, multi.stop());
+	for (uint8_t n = 0; n < numBuses; ++n)
+		CHECK_EQUAL(values[n], registers[n][9]);
+	CHECK(allIdle());
+}
+
+
+// Stretches on one bus hold all buses, each is shorter than the timeout
+static void testClockStretch(void)
+{
+	setUp();
+	sensors[1].setStretch(100);
+	uint8_t reg = 0;
+	uint8_t out[numBuses * 4];
+	SoftWireMulti::busMask_t acked = 0;
+	CHECK_EQUAL(SoftWire::ack, multi.readRegister(0x40, &reg, 1, out, 4, acked));
+	CHECK_EQUAL(0xF, acked);
+	for (uint8_t n = 0; n < numBuses; ++n)
+		CHECK_MEMORY(registers[n], &out[n * 4], 4);
+	CHECK(allIdle());
+}
+
+
+// SCL held low on one bus: the transfer and the stop must give up
+static void testSclStuck(void)
+{
+	setUp();
+	sclStuck[3] = true;
+	uint8_t reg = 0;
+	uint8_t out[numBuses];
+	SoftWireMulti::busMask_t acked = 0;
+	CHECK_EQUAL(SoftWire::timedOut, multi.readRegister(0x40, &reg, 1, out, 1, acked));
+	CHECK_EQUAL(SoftWire::timedOut, multi.stop());
+	CHECK_EQUAL(SoftWire::sclStuck, multi.recoverBus());
+
+	sclStuck[3] = false;
+	multi.begin();
+	CHECK_EQUAL(SoftWire::ack, multi.readRegister(0x40, &reg, 1, out, 1, acked));
+	CHECK_EQUAL(0xF, acked);
+	CHECK(allIdle());
+}
+
+
+// A read abandoned whilst every slave drives a zero bit onto SDA
+static void testRecoverBus(void)
+{
+	setUp();
+	for (uint8_t n = 0; n < numBuses; ++n)
+		registers[n][0] = 0x00;
+	uint8_t reg = 0;
+	SoftWireMulti::busMask_t acked = 0;
+	CHECK_EQUAL(SoftWire::ack, multi.llStart((0x40 << 1) + SoftWire::writeMode, acked));
+	CHECK_EQUAL(SoftWire::ack, multi.llWrite(reg, acked));
+	CHECK_EQUAL(SoftWire::ack, multi.llRepeatedStart((0x40 << 1) + SoftWire::readMode, acked));
+	for (uint8_t n = 0; n < numBuses; ++n)
+		CHECK_EQUAL(LOW, buses[n].getSda());
+
+	CHECK_EQUAL(SoftWire::busRecovered, multi.recoverBus());
+	CHECK(allIdle());
+	CHECK_EQUAL(SoftWire::busOk, multi.recoverBus());
+
+	uint8_t out[numBuses];
+	reg = 1;
+	CHECK_EQUAL(SoftWire::ack, multi.readRegister(0x40, &reg, 1, out, 1, acked));
+	for (uint8_t n = 0; n < numBuses; ++n)
+		CHECK_EQUAL(registers[n][1], out[n]);
+}
+
+
+int main(void)
+{
+	hostHook = updatePorts;
+	multi.setSdaPort(&sdaMode, &sdaOutput, &sdaInput);
+	multi.setSclPort(&sclMode, &sclOutput, &sclInput);
+	for (uint8_t n = 0; n < numBuses; ++n) {
+		buses[n].addDevice(sensors[n]);
+		CHECK_EQUAL(n, multi.addBus(sdaBit(n), sclBit(n)));
+	}
+	CHECK_EQUAL(0xF, multi.getAllBuses());
+	setUp();
+	multi.begin();
+	CHECK(allIdle());
+
+	RUN_TEST(testReadRegister);
+	RUN_TEST(testPartialNack);
+	RUN_TEST(testWrite);
+	RUN_TEST(testClockStretch);
+	RUN_TEST(testSclStuck);
+	RUN_TEST(testRecoverBus);
+	return testSummary("test_multi");
+}
@@ -0,0 +1,247 @@
+// SoftWire's direct port drivers on mock port registers. The library is
+// compiled for a core with port registers (ARDUINO_ARCH_MEGAAVR), which
+// the stubs map onto arrays. The hook called by the simulated clock
+// copies the master's outputs onto the simulated bus and the bus levels
+// back into the input registers.
+
+#include <SoftWire.h>
+#include <SoftWireSim.h>
+#include "test.h"
+
+// The registers and mask of one line
+struct line_t {
+	SoftWire::portReg_t *mode;
+	SoftWire::portReg_t *output;
+	SoftWire::portReg_t *input;
+	SoftWire::portValue_t mask;
+};
+
+uint8_t registers[16];
+
+SoftWireSim bus;
+SoftWireSimRegisters sensor(0x40, registers, sizeof(registers));
+line_t sdaLine;
+line_t sclLine;
+
+unsigned long pinModeCalls;
+unsigned long pinIoCalls;
+
+
+static void connect(line_t &line, SoftWire::portReg_t *mode, SoftWire::portReg_t *output,
+					SoftWire::portReg_t *input, SoftWire::portValue_t mask)
+{
+	line.mode = mode;
+	line.output = output;
+	line.input = input;
+	line.mask = mask;
+}
+
+
+static uint8_t masterLevel(const line_t &line)
+{
+	return ((*line.mode & line.mask) && !(*line.output & line.mask)) ? LOW : HIGH;
+}
+
+
+static void setInput(const line_t &line, uint8_t level)
+{
+	if (level)
+		*line.input |= line.mask;
+	else
+		*line.input &= ~line.mask;
+}
+
+
+static void updatePorts(void)
+{
+	if (sdaLine.mode == NULL)
+		return;
+
+	// SoftWire only changes SDA whilst SCL is low, except for a start or
+	// stop which is followed by a delay, so SCL falls first and rises last
+	uint8_t scl = masterLevel(sclLine);
+	if (scl == LOW)
+		bus.setMasterScl(LOW);
+	bus.setMasterSda(masterLevel(sdaLine));
+	bus.setMasterScl(scl);
+	setInput(sdaLine, bus.readSda());
+	setInput(sclLine, bus.readScl());
+}
+
+
+static void countPinMode(uint8_t pin, uint8_t mode)
+{
+	(void)pin;
+	(void)mode;
+	++pinModeCalls;
+}
+
+
+static void countWrite(uint8_t pin, uint8_t val)
+{
+	(void)pin;
+	(void)val;
+	++pinIoCalls;
+}
+
+
+static int countRead(uint8_t pin)
+{
+	(void)pin;
+	++pinIoCalls;
+	return HIGH;
+}
+
+
+static void setUp(void)
+{
+	for (uint8_t i = 0; i < sizeof(registers); ++i)
+		registers[i] = 0x30 + i;
+	memset((void*)hostPortMode, 0, sizeof(hostPortMode));
+	memset((void*)hostPortOutput, 0, sizeof(hostPortOutput));
+	memset((void*)hostPortInput, 0xFF, sizeof(hostPortInput));
+	pinModeCalls = 0;
+	pinIoCalls = 0;
+	bus.resetStats();
+}
+
+
+static bool busIdle(void)
+{
+	return bus.getSda() == HIGH && bus.getScl() == HIGH;
+}
+
+
+static void checkTransfer(SoftWire &sw)
+{
+	uint8_t reg = 3;
+	const uint8_t values[] = {0xE1, 0xE2};
+	CHECK_EQUAL(SoftWire::ack, sw.writeRegister(0x40, &reg, 1, values, sizeof(values)));
+	CHECK_MEMORY(values, &registers[3], sizeof(values));
+
+	uint8_t data[4];
+	reg = 2;
+	CHECK_EQUAL(SoftWire::ack, sw.readRegister(0x40, &reg, 1, data, sizeof(data)));
+	const uint8_t expected[] = {0x32, 0xE1, 0xE2, 0x35};
+	CHECK_MEMORY(expected, data, sizeof(data));
+	CHECK_EQUAL(SoftWire::nack, sw.startWrite(0x41));
+	sw.stop();
+	CHECK(busIdle());
+}
+
+
+// Each driver changes only its own bit
+static void testRegisterBits(void)
+{
+	setUp();
+	SoftWire::portReg_t mode = 0x81;
+	SoftWire::portReg_t output = 0x81;
+	SoftWire::portReg_t input = 0x00;
+	SoftWire sw(0, 0);
+	sw.setSdaPort(&mode, &output, &input, 0x10);
+	sw.setSclPort(&mode, &output, &input, 0x20);
+
+	SoftWire::sdaLowDirect(&sw);
+	CHECK_EQUAL(0x91, mode);
+	CHECK_EQUAL(0x81, output);
+	SoftWire::sclLowDirect(&sw);
+	CHECK_EQUAL(0xB1, mode);
+	CHECK_EQUAL(0x81, output);
+	SoftWire::sdaHighDirect(&sw);
+	CHECK_EQUAL(0xA1, mode);
+	CHECK_EQUAL(0x81, output);
+	SoftWire::sclHighDirect(&sw);
+	CHECK_EQUAL(0x81, mode);
+	CHECK_EQUAL(0x81, output);
+
+	// With pullups the output bit of a released line is set
+	sw.enablePullups();
+	SoftWire::sdaLowDirect(&sw);
+	CHECK_EQUAL(0x91, mode);
+	CHECK_EQUAL(0x81, output);
+	SoftWire::sdaHighDirect(&sw);
+	CHECK_EQUAL(0x81, mode);
+	CHECK_EQUAL(0x91, output);
+	SoftWire::sclHighDirect(&sw);
+	CHECK_EQUAL(0xB1, output);
+
+	CHECK_EQUAL(LOW, SoftWire::readSdaDirect(&sw));
+	input = 0x10;
+	CHECK_EQUAL(HIGH, SoftWire::readSdaDirect(&sw));
+	CHECK_EQUAL(LOW, SoftWire::readSclDirect(&sw));
+	input = 0xEF;
+	CHECK_EQUAL(LOW, SoftWire::readSdaDirect(&sw));
+	CHECK_EQUAL(HIGH, SoftWire::readSclDirect(&sw));
+}
+
+
+// Registers supplied with setSdaPort() and setSclPort(), SDA and SCL on
+// different ports
+static void testExplicitPorts(void)
+{
+	setUp();
+	SoftWire::portReg_t sdaMode = 0, sdaOutput = 0, sdaInput = 0xFF;
+	SoftWire::portReg_t sclMode = 0, sclOutput = 0, sclInput = 0xFF;
+	SoftWire sw(0, 0);
+	sw.setSdaPort(&sdaMode, &sdaOutput, &sdaInput, 0x01);
+	sw.setSclPort(&sclMode, &sclOutput, &sclInput, 0x80);
+	sw.setDelay_us(1);
+	connect(sdaLine, &sdaMode, &sdaOutput, &sdaInput, 0x01);
+	connect(sclLine, &sclMode, &sclOutput, &sclInput, 0x80);
+
+	sw.begin();
+	CHECK(busIdle());
+	CHECK_EQUAL(0, sdaMode);
+	CHECK_EQUAL(0, sclMode);
+	checkTransfer(sw);
+	CHECK(bus.getStats().edges > 0);
+	CHECK_EQUAL(0, sdaMode);
+	CHECK_EQUAL(0, sclMode);
+	CHECK_EQUAL(0, pinModeCalls + pinIoCalls);
+	sdaLine.mode = NULL;
+}
+
+
+// Registers resolved from the pin numbers by begin(). Pins 10 and 11
+// are bits 2 and 3 of port 1.
+static void testResolvedPorts(void)
+{
+	setUp();
+	SoftWire sw(10, 11);
+	sw.useDirectPortAccess();
+	sw.setDelay_us(1);
+	connect(sdaLine, &hostPortMode[1], &hostPortOutput[1], &hostPortInput[1], 0x04);
+	connect(sclLine, &hostPortMode[1], &hostPortOutput[1], &hostPortInput[1], 0x08);
+
+	sw.begin();
+	CHECK_EQUAL(2, pinModeCalls); // Pins configured once by the core
+	CHECK(busIdle());
+	checkTransfer(sw);
+	CHECK_EQUAL(2, pinModeCalls);
+	CHECK_EQUAL(0, pinIoCalls);
+	CHECK_EQUAL(0, hostPortMode[1]);
+	CHECK_EQUAL(0, hostPortMode[0] | hostPortMode[2] | hostPortMode[3]);
+	sdaLine.mode = NULL;
+
+	// An invalid pin reverts to the pin functions
+	SoftWire invalid(10, NUM_DIGITAL_PINS);
+	invalid.useDirectPortAccess();
+	invalid.setDelay_us(1);
+	invalid.begin();
+	CHECK(pinIoCalls > 0);
+}
+
+
+int main(void)
+{
+	hostHook = updatePorts;
+	hostPinMode = countPinMode;
+	hostDigitalWrite = countWrite;
+	hostDigitalRead = countRead;
+	bus.addDevice(sensor);
+
+	RUN_TEST(testRegisterBits);
+	RUN_TEST(testExplicitPorts);
+	RUN_TEST(testResolvedPorts);
+	return testSummary("test_ports");
+}
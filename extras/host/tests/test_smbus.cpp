@@ -0,0 +1,183 @@
+// SoftWireSmBus and SoftWire PEC on simulated SMBus and register devices
+
+#include <SoftWire.h>
+#include <SoftWireSim.h>
+#include <SoftWireSmBus.h>
+#include "test.h"
+
+uint16_t words[32];
+uint8_t registers[32];
+
+SoftWireSim bus;
+SoftWireSimSmBus device(0x5A, words, 32);
+SoftWireSimRegisters sensor(0x40, registers, sizeof(registers));
+SoftWire sw(0, 0);
+SoftWireSmBus smbus(sw, 0x5A, true);
+SoftWireSmBus plain(sw, 0x40);
+
+
+static void setUp(void)
+{
+	for (uint8_t i = 0; i < 32; ++i) {
+		words[i] = 0x1000 * (i & 0xF) + i;
+		registers[i] = i;
+	}
+	sw.enablePec(false);
+	smbus.enablePec(true);
+	plain.enablePec(false);
+	bus.resetStats();
+}
+
+
+static void testReadWord(void)
+{
+	setUp();
+	words[7] = 0x3AB4;
+	uint16_t value = 0;
+	CHECK_EQUAL(SoftWireSmBus::ok, smbus.readWord(7, value));
+	CHECK_EQUAL(0x3AB4, value);
+	CHECK_EQUAL(2, bus.getStats().starts);
+	CHECK_EQUAL(1, bus.getStats().stops);
+
+	// Command out of range is not acknowledged
+	CHECK_EQUAL(SoftWireSmBus::nack, smbus.readWord(40, value));
+	CHECK_EQUAL(0x3AB4, value);
+}
+
+
+static void testWriteWord(void)
+{
+	setUp();
+	CHECK_EQUAL(SoftWireSmBus::ok, smbus.writeWord(3, 0x1234));
+	CHECK_EQUAL(0x1234, words[3]);
+	uint16_t value = 0;
+	CHECK_EQUAL(SoftWireSmBus::ok, smbus.readWord(3, value));
+	CHECK_EQUAL(0x1234, value);
+
+	// The device discards writes without a valid PEC
+	smbus.enablePec(false);
+	CHECK_EQUAL(SoftWireSmBus::ok, smbus.writeWord(3, 0x5678));
+	CHECK_EQUAL(0x1234, words[3]);
+}
+
+
+static void testPecError(void)
+{
+	setUp();
+	// The register device sends the next register in place of a PEC
+	SoftWireSmBus bad(sw, 0x40, true);
+	uint16_t value = 0;
+	CHECK_EQUAL(SoftWireSmBus::pecError, bad.readWord(0, value));
+	CHECK_EQUAL(1, bus.getStats().stops);
+	CHECK(bus.getSda() == HIGH && bus.getScl() == HIGH);
+
+	bad.enablePec(false);
+	CHECK_EQUAL(SoftWireSmBus::ok, bad.readWord(0, value));
+	CHECK_EQUAL(0x0100, value);
+}
+
+
+// The PEC setting of the SoftWire object is restored after each
+// transaction
+static void testPecRestored(void)
+{
+	setUp();
+	uint16_t value;
+	sw.enablePec(false);
+	CHECK_EQUAL(SoftWireSmBus::ok, smbus.readWord(1, value));
+	CHECK(!sw.isPecEnabled());
+
+	sw.enablePec(true);
+	CHECK_EQUAL(SoftWireSmBus::ok, plain.readWord(1, value));
+	CHECK(sw.isPecEnabled());
+	CHECK_EQUAL(0x0201, value);
+	sw.enablePec(false);
+}
+
+
+// PEC accumulated by SoftWire for a plain readRegister()
+static void testSoftWirePec(void)
+{
+	setUp();
+	sw.enablePec();
+	uint8_t command = 7;
+	uint8_t data[3];
+	CHECK_EQUAL(SoftWire::ack, sw.readRegister(0x5A, &command, 1, data, sizeof(data)));
+	CHECK_EQUAL(0, sw.getPec());
+	CHECK_EQUAL(words[7] & 0xFF, data[0]);
+	CHECK_EQUAL(words[7] >> 8, data[1]);
+
+	// The same check by hand
+	uint8_t pec = 0;
+	pec = SoftWire::crc8_update(pec, 0x5A << 1);
+	pec = SoftWire::crc8_update(pec, command);
+	pec = SoftWire::crc8_update(pec, (0x5A << 1) + 1);
+	pec = SoftWire::crc8_update(pec, data[0]);
+	pec = SoftWire::crc8_update(pec, data[1]);
+	CHECK_EQUAL(pec, data[2]);
+
+	sw.resetPec();
+	CHECK_EQUAL(0, sw.getPec());
+	sw.enablePec(false);
+}
+
+
+static void testByteAndBlock(void)
+{
+	setUp();
+	uint8_t value = 0;
+	CHECK_EQUAL(SoftWireSmBus::ok, plain.readByte(9, value));
+	CHECK_EQUAL(9, value);
+	CHECK_EQUAL(SoftWireSmBus::ok, plain.writeByte(9, 0x99));
+	CHECK_EQUAL(0x99, registers[9]);
+	CHECK_EQUAL(SoftWireSmBus::ok, plain.sendByte(12));
+	CHECK_EQUAL(SoftWireSmBus::ok, plain.receiveByte(value));
+	CHECK_EQUAL(12, value);
+
+	// A block read of 3 bytes: count at register 16, data follows
+	registers[16] = 3;
+	uint8_t block[4] = {0};
+	uint8_t count = 0;
+	CHECK_EQUAL(SoftWireSmBus::ok, plain.blockRead(16, block, sizeof(block), count));
+	CHECK_EQUAL(3, count);
+	CHECK_MEMORY(&registers[17], block, 3);
+
+	// Count larger than the buffer
+	CHECK_EQUAL(SoftWireSmBus::blockSizeError, plain.blockRead(16, block, 2, count));
+	CHECK_EQUAL(0, count);
+	CHECK(bus.getSda() == HIGH && bus.getScl() == HIGH);
+
+	const uint8_t data[] = {0xB1, 0xB2};
+	CHECK_EQUAL(SoftWireSmBus::ok, plain.blockWrite(20, data, sizeof(data)));
+	CHECK_EQUAL(2, registers[20]);
+	CHECK_MEMORY(data, &registers[21], sizeof(data));
+}
+
+
+static void testQuickCommand(void)
+{
+	setUp();
+	CHECK_EQUAL(SoftWireSmBus::ok, smbus.quickCommand(SoftWire::writeMode));
+	SoftWireSmBus absent(sw, 0x22);
+	CHECK_EQUAL(SoftWireSmBus::nack, absent.quickCommand(SoftWire::writeMode));
+	CHECK_EQUAL(2, bus.getStats().stops);
+}
+
+
+int main(void)
+{
+	bus.addDevice(device);
+	bus.addDevice(sensor);
+	bus.attach(sw);
+	sw.setDelay_us(1);
+	sw.begin();
+
+	RUN_TEST(testReadWord);
+	RUN_TEST(testWriteWord);
+	RUN_TEST(testPecError);
+	RUN_TEST(testPecRestored);
+	RUN_TEST(testSoftWirePec);
+	RUN_TEST(testByteAndBlock);
+	RUN_TEST(testQuickCommand);
+	return testSummary("test_smbus");
+}
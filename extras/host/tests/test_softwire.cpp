@@ -0,0 +1,551 @@
+// SoftWire on the simulated bus: register access, scan, clock stretching,
+// timeouts, bus recovery and the Wire-compatible interface.
+
+#include <SoftWire.h>
+#include <SoftWireSim.h>
+#include "test.h"
+
+uint8_t registers[32];
+uint8_t memory[64];
+
+SoftWireSim bus;
+SoftWireSimRegisters sensor(0x40, registers, sizeof(registers));
+SoftWireSimRegisters other(0x50, memory, sizeof(memory));
+SoftWire sw(0, 0);
+
+
+static void setUp(void)
+{
+	for (uint8_t i = 0; i < sizeof(registers); ++i)
+		registers[i] = i;
+	sensor.setStretch(0);
+	sw.setDelay_us(1);
+	sw.setTimeout_us(1000);
+	sw.setTransactionTimeout_us(0);
+	sw.enablePec(false);
+	bus.resetStats();
+}
+
+
+static bool busIdle(void)
+{
+	return bus.getSda() == HIGH && bus.getScl() == HIGH;
+}
+
+
+// Let a stretching slave release SCL
+static void waitForRelease(void)
+{
+	for (int i = 0; i < 10000 && bus.getScl() == LOW; ++i)
+		bus.readScl();
+}
+
+
+static void testReadRegister(void)
+{
+	setUp();
+	uint8_t reg = 4;
+	uint8_t data[4];
+	CHECK_EQUAL(SoftWire::ack, sw.readRegister(0x40, &reg, 1, data, sizeof(data)));
+	const uint8_t expected[] = {4, 5, 6, 7};
+	CHECK_MEMORY(expected, data, sizeof(data));
+	CHECK_EQUAL(2, bus.getStats().starts); // Start and repeated start
+	CHECK_EQUAL(1, bus.getStats().stops);
+	CHECK_EQUAL(5, bus.getStats().bytes);
+	CHECK(busIdle());
+}
+
+
+static unsigned long driverCalls(void)
+{
+	const SoftWireSim::stats_t &stats = bus.getStats();
+	return stats.sdaLow + stats.sdaHigh + stats.sclLow + stats.sclHigh
+		+ stats.readSda + stats.readScl;
+}
+
+
+// Lines already at the required level are not driven again. Every byte
+// has 18 SCL edges: SCL is already low from the previous byte or the
+// start, and is left low after the ACK bit.
+static void testLineEdges(void)
+{
+	setUp();
+
+	// SDA and SCL fall, then 0x80: SDA rises, falls, and is released
+	// for the ACK
+	CHECK_EQUAL(SoftWire::ack, sw.startWrite(0x40));
+	CHECK_EQUAL(2 + 18 + 3, bus.getStats().edges);
+	bus.resetStats();
+
+	// SDA is already released after the ACK, so it is never driven
+	CHECK_EQUAL(SoftWire::ack, sw.llWrite(0xFF));
+	CHECK_EQUAL(18, bus.getStats().edges);
+	CHECK_EQUAL(0, bus.getStats().sdaLow + bus.getStats().sdaHigh);
+	bus.resetStats();
+
+	// SDA is already high for the repeated start: SCL rises, SDA and
+	// SCL fall, then 0x81: SDA rises, falls and rises
+	CHECK_EQUAL(SoftWire::ack, sw.repeatedStartRead(0x40));
+	CHECK_EQUAL(3 + 18 + 3, bus.getStats().edges);
+	CHECK_EQUAL(2, bus.getStats().sdaHigh); // Address bits only
+	CHECK_EQUAL(1, bus.getStats().starts);
+	bus.resetStats();
+
+	uint8_t data;
+	CHECK_EQUAL(SoftWire::ack, sw.readThenNack(data));
+	CHECK_EQUAL(18, bus.getStats().edges);
+	bus.resetStats();
+
+	// SCL is already low: SDA falls, SCL rises, SDA rises
+	CHECK_EQUAL(SoftWire::ack, sw.stop());
+	CHECK_EQUAL(3, bus.getStats().edges);
+	CHECK_EQUAL(0, bus.getStats().sclLow);
+	CHECK_EQUAL(1, bus.getStats().sclHigh);
+	CHECK_EQUAL(1, bus.getStats().sdaLow);
+	CHECK_EQUAL(1, bus.getStats().sdaHigh);
+	CHECK_EQUAL(1, bus.getStats().stops);
+	bus.resetStats();
+
+	// A second stop on the idle bus does nothing
+	CHECK_EQUAL(SoftWire::ack, sw.stop());
+	CHECK_EQUAL(0, driverCalls());
+	CHECK(busIdle());
+}
+
+
+static void testWriteRegister(void)
+{
+	setUp();
+	uint8_t reg = 10;
+	const uint8_t data[] = {0xA1, 0xA2, 0xA3};
+	CHECK_EQUAL(SoftWire::ack, sw.writeRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK_MEMORY(data, &registers[10], sizeof(data));
+	CHECK_EQUAL(13, registers[13]);
+	CHECK_EQUAL(1, bus.getStats().starts);
+	CHECK_EQUAL(1, bus.getStats().stops);
+	CHECK(busIdle());
+}
+
+
+static void testNack(void)
+{
+	setUp();
+	uint8_t reg = 0;
+	uint8_t data[2] = {0x55, 0x55};
+	CHECK_EQUAL(SoftWire::nack, sw.readRegister(0x41, &reg, 1, data, sizeof(data)));
+	CHECK_EQUAL(0x55, data[0]);
+	CHECK_EQUAL(1, bus.getStats().starts);
+	CHECK_EQUAL(1, bus.getStats().stops);
+	CHECK_EQUAL(SoftWire::noPhase, sw.getTimeoutPhase());
+	CHECK(busIdle());
+}
+
+
+static void testScan(void)
+{
+	setUp();
+	uint8_t bitmap[16];
+	CHECK_EQUAL(SoftWire::ack, sw.scan(bitmap));
+	for (uint8_t addr = 0x01; addr <= 0x7F; ++addr) {
+		bool found = bitmap[addr >> 3] & (1 << (addr & 7));
+		CHECK_EQUAL(addr == 0x40 || addr == 0x50, found);
+	}
+	CHECK_EQUAL(0x7F, bus.getStats().starts);
+	CHECK_EQUAL(0x7F, bus.getStats().stops);
+
+	memset(bitmap, 0, sizeof(bitmap));
+	CHECK_EQUAL(SoftWire::ack, sw.scan(bitmap, 0x41, 0x4F));
+	for (uint8_t i = 0; i < sizeof(bitmap); ++i)
+		CHECK_EQUAL(0, bitmap[i]);
+	CHECK(busIdle());
+}
+
+
+// The slave stretches SCL after every byte it acknowledges. Each stretch
+// is shorter than the timeout but the transfer as a whole is much longer.
+static void testClockStretch(void)
+{
+	setUp();
+	sensor.setStretch(50);
+	sw.setTimeout_us(200);
+	uint8_t reg = 0;
+	uint8_t data[31];
+	for (uint8_t i = 0; i < sizeof(data); ++i)
+		data[i] = 0x80 + i;
+	unsigned long start = micros();
+	CHECK_EQUAL(SoftWire::ack, sw.writeRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK(micros() - start > 1000);
+	CHECK_MEMORY(data, registers, sizeof(data));
+	CHECK_EQUAL(SoftWire::noPhase, sw.getTimeoutPhase());
+	CHECK(busIdle());
+}
+
+
+static void testStretchTimeout(void)
+{
+	setUp();
+	sensor.setStretch(5000);
+	sw.setTimeout_us(200);
+	uint8_t reg = 0;
+	uint8_t data[2];
+	CHECK_EQUAL(SoftWire::timedOut, sw.readRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK(sw.getTimeoutPhase() != SoftWire::noPhase);
+
+	// The slave eventually releases SCL, the bus is usable again
+	sensor.setStretch(0);
+	waitForRelease();
+	SoftWire::busStatus_t status = sw.recoverBus();
+	CHECK(status == SoftWire::busOk || status == SoftWire::busRecovered);
+	CHECK_EQUAL(SoftWire::ack, sw.readRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK_EQUAL(SoftWire::noPhase, sw.getTimeoutPhase());
+	CHECK(busIdle());
+}
+
+
+static void testTransactionTimeout(void)
+{
+	setUp();
+	sensor.setStretch(50);
+	sw.setTimeout_us(200);
+	sw.setTransactionTimeout_us(500);
+	uint8_t reg = 0;
+	uint8_t data[31];
+	CHECK_EQUAL(SoftWire::timedOut, sw.writeRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK(sw.getTimeoutPhase() != SoftWire::noPhase);
+
+	sw.setTransactionTimeout_us(0);
+	waitForRelease();
+	CHECK_EQUAL(SoftWire::ack, sw.writeRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK_EQUAL(SoftWire::noPhase, sw.getTimeoutPhase());
+	CHECK(busIdle());
+}
+
+
+// Without any clock stretching the deadline is checked between bytes
+static void testTransactionDeadline(void)
+{
+	setUp();
+	sw.setTransactionTimeout_us(10);
+	uint8_t reg = 0;
+	uint8_t data[30];
+	CHECK_EQUAL(SoftWire::timedOut, sw.readRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK(sw.getTimeoutPhase() == SoftWire::writePhase
+		  || sw.getTimeoutPhase() == SoftWire::readPhase);
+	CHECK(busIdle());
+	CHECK(bus.getStats().bytes < 1 + sizeof(data));
+
+	CHECK_EQUAL(SoftWire::timedOut, sw.writeRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK_EQUAL(SoftWire::writePhase, sw.getTimeoutPhase());
+	CHECK(busIdle());
+
+	sw.setTransactionTimeout_us(0);
+	CHECK_EQUAL(SoftWire::ack, sw.readRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK_MEMORY(registers, data, sizeof(data));
+	CHECK_EQUAL(SoftWire::noPhase, sw.getTimeoutPhase());
+}
+
+
+// A read is abandoned whilst the slave drives a zero bit onto SDA
+static void testRecoverBus(void)
+{
+	setUp();
+	registers[0] = 0x00;
+	uint8_t reg = 0;
+	CHECK_EQUAL(SoftWire::ack, sw.writeRegister(0x40, &reg, 1, NULL, 0));
+	CHECK_EQUAL(SoftWire::ack, sw.startRead(0x40));
+	CHECK_EQUAL(LOW, bus.getSda());
+
+	CHECK_EQUAL(SoftWire::busRecovered, sw.recoverBus());
+	CHECK_EQUAL(SoftWire::busRecovered, sw.getBusStatus());
+	CHECK(busIdle());
+
+	uint8_t data[2];
+	reg = 1;
+	CHECK_EQUAL(SoftWire::ack, sw.readRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK_EQUAL(1, data[0]);
+	CHECK_EQUAL(2, data[1]);
+	CHECK_EQUAL(SoftWire::busOk, sw.recoverBus());
+}
+
+
+static uint8_t readLow(const SoftWire *p)
+{
+	(void)p;
+	return LOW;
+}
+
+
+// SCL held low permanently: every function must give up and return
+static void testSclStuck(void)
+{
+	setUp();
+	SoftWireSim stuckBus;
+	SoftWire stuck(0, 0);
+	stuckBus.attach(stuck);
+	stuck.setReadScl(readLow);
+	stuck.setDelay_us(1);
+	stuck.setTimeout_us(100);
+
+	CHECK_EQUAL(SoftWire::sclStuck, stuck.recoverBus());
+	CHECK_EQUAL(SoftWire::timedOut, stuck.startWrite(0x40));
+	CHECK_EQUAL(SoftWire::timedOut, stuck.stop());
+	uint8_t reg = 0;
+	uint8_t data;
+	CHECK_EQUAL(SoftWire::timedOut, stuck.readRegister(0x40, &reg, 1, &data, 1));
+	uint8_t bitmap[16];
+	CHECK_EQUAL(SoftWire::timedOut, stuck.scan(bitmap));
+}
+
+
+static void testTransfer(void)
+{
+	setUp();
+	static const uint8_t cmd[] = {8};
+	uint8_t a[2];
+	uint8_t b[3];
+	const SoftWire::segment_t segs[] = {
+		SoftWire::segment_t::write(cmd, sizeof(cmd)),
+		SoftWire::segment_t::read(a, sizeof(a)),
+		SoftWire::segment_t::read(b, sizeof(b)),
+	};
+	CHECK_EQUAL(SoftWire::ack, sw.transfer(0x40, segs, 3));
+	CHECK_MEMORY(&registers[8], a, sizeof(a));
+	CHECK_MEMORY(&registers[10], b, sizeof(b));
+	CHECK_EQUAL(2, bus.getStats().starts);
+	CHECK_EQUAL(1, bus.getStats().stops);
+}
+
+
+static void testQueue(void)
+{
+	setUp();
+	SoftWire::transaction_t queue[3];
+	sw.setQueue(queue, 3);
+	static const uint8_t write[] = {20, 0xEE};
+	static const uint8_t reg[] = {20};
+	uint8_t data[2];
+	CHECK(sw.enqueueWrite(0x40, write, sizeof(write)));
+	CHECK(sw.enqueueWrite(0x40, reg, sizeof(reg)));
+	CHECK(sw.enqueueRead(0x40, data, sizeof(data)));
+	CHECK(!sw.enqueueRead(0x40, data, sizeof(data)));
+	CHECK(queue[0].txData == write && queue[0].rxData == NULL);
+	CHECK(queue[2].txData == NULL && queue[2].rxData == data);
+	CHECK_EQUAL(SoftWire::ack, sw.execute());
+	CHECK_EQUAL(0, sw.getQueueLength());
+	CHECK_EQUAL(0xEE, data[0]);
+	CHECK_EQUAL(21, data[1]);
+	CHECK_EQUAL(SoftWire::ack, queue[2].result);
+	CHECK_EQUAL(3, bus.getStats().starts);
+	CHECK_EQUAL(1, bus.getStats().stops);
+
+	CHECK(sw.enqueueWrite(0x41, reg, sizeof(reg)));
+	CHECK(sw.enqueueRead(0x40, data, sizeof(data)));
+	CHECK_EQUAL(SoftWire::nack, sw.execute());
+	CHECK_EQUAL(SoftWire::nack, queue[0].result);
+	CHECK(busIdle());
+}
+
+
+static void testWire(void)
+{
+	setUp();
+	uint8_t txBuffer[8];
+	uint8_t rxBuffer[300];
+	sw.setTxBuffer(txBuffer, sizeof(txBuffer));
+	sw.setRxBuffer(rxBuffer, sizeof(rxBuffer));
+
+	sw.beginTransmission(0x40);
+	sw.write(uint8_t(3));
+	CHECK_EQUAL(0, sw.endTransmission());
+	CHECK_EQUAL(2, sw.requestFrom(0x40, 2));
+	CHECK_EQUAL(2, sw.available());
+	CHECK_EQUAL(3, sw.read());
+	CHECK_EQUAL(4, sw.read());
+	CHECK_EQUAL(-1, sw.read());
+
+	// More than 255 bytes through the int overload
+	sw.beginTransmission(0x40);
+	sw.write(uint8_t(0));
+	CHECK_EQUAL(0, sw.endTransmission());
+	CHECK_EQUAL(300, sw.requestFrom(0x40, 300));
+	CHECK_EQUAL(300, sw.available());
+	bool same = true;
+	for (int i = 0; i < 300; ++i)
+		same = same && sw.read() == i % 32;
+	CHECK(same);
+
+	// A read which misses the transaction deadline keeps the bytes
+	// already received
+	sw.beginTransmission(0x40);
+	sw.write(uint8_t(0));
+	CHECK_EQUAL(0, sw.endTransmission());
+	sw.setTransactionTimeout_us(100);
+	size_t n = sw.requestFrom(0x40, 300);
+	CHECK(n > 0 && n < 300);
+	CHECK_EQUAL(int(n), sw.available());
+	same = true;
+	for (size_t i = 0; i < n; ++i)
+		same = same && sw.read() == int(i % 32);
+	CHECK(same);
+	CHECK_EQUAL(SoftWire::readPhase, sw.getTimeoutPhase());
+	sw.setTransactionTimeout_us(0);
+
+	uint8_t buffer[4];
+	size_t count = 99;
+	CHECK_EQUAL(SoftWire::ack, sw.startRead(0x40));
+	CHECK_EQUAL(SoftWire::ack, sw.llReadBuffer(buffer, sizeof(buffer), true, &count));
+	CHECK_EQUAL(sizeof(buffer), count);
+	sw.stop();
+
+	sw.beginTransmission(0x41);
+	CHECK_EQUAL(2, sw.endTransmission()); // NACK on address
+	CHECK_EQUAL(0, sw.requestFrom(0x41, 2));
+	CHECK(busIdle());
+}
+
+
+static void testSpans(void)
+{
+	setUp();
+	uint8_t txBuffer[8];
+	sw.setTxBuffer(txBuffer, sizeof(txBuffer));
+	sw.clearWriteError();
+
+	// Sent in order under one start and stop; an empty span sends nothing
+	const uint8_t reg[] = {5};
+	const uint8_t data1[] = {0xA1, 0xA2};
+	const uint8_t data2[] = {0xA3};
+	const SoftWire::span_t spans[] = {
+		{reg, sizeof(reg)},
+		{data1, sizeof(data1)},
+		{data1, 0},
+		{data2, sizeof(data2)},
+	};
+	sw.beginTransmission(0x40, spans, 4);
+	CHECK_EQUAL(0, sw.endTransmission());
+	CHECK_EQUAL(1, bus.getStats().starts);
+	CHECK_EQUAL(1, bus.getStats().stops);
+	CHECK_EQUAL(4, bus.getStats().bytes);
+	const uint8_t expected[] = {4, 0xA1, 0xA2, 0xA3, 8};
+	CHECK_MEMORY(expected, registers + 4, sizeof(expected));
+	CHECK(busIdle());
+
+	// write() is rejected and does not alter the data sent
+	sw.beginTransmission(0x40, spans, 2);
+	CHECK_EQUAL(0, sw.write(uint8_t(0x55)));
+	CHECK(sw.getWriteError() != 0);
+	CHECK_EQUAL(0, sw.endTransmission());
+	CHECK_EQUAL(0xA1, registers[5]);
+	CHECK_EQUAL(8, registers[8]);
+	sw.clearWriteError();
+
+	// The buffer is used again after endTransmission()
+	sw.beginTransmission(0x40);
+	CHECK_EQUAL(1, sw.write(uint8_t(8)));
+	CHECK_EQUAL(1, sw.write(uint8_t(0x88)));
+	CHECK_EQUAL(0, sw.endTransmission());
+	CHECK_EQUAL(0x88, registers[8]);
+	CHECK_EQUAL(0, sw.getWriteError());
+
+	// No spans, or only empty ones: the address alone is sent
+	bus.resetStats();
+	sw.beginTransmission(0x40, spans, 0);
+	CHECK_EQUAL(0, sw.endTransmission());
+	const SoftWire::span_t empty[] = {{reg, 0}, {NULL, 0}};
+	sw.beginTransmission(0x40, empty, 2);
+	CHECK_EQUAL(0, sw.endTransmission());
+	CHECK_EQUAL(2, bus.getStats().starts);
+	CHECK_EQUAL(2, bus.getStats().stops);
+	CHECK_EQUAL(0, bus.getStats().bytes);
+
+	// NACK on address
+	sw.beginTransmission(0x41, spans, 4);
+	CHECK_EQUAL(2, sw.endTransmission());
+	CHECK(busIdle());
+}
+
+
+// SoftWire's own line drivers, through pinMode(), digitalWrite() and
+// digitalRead(), connected to the simulated bus
+static const uint8_t sdaPin = 4;
+static const uint8_t sclPin = 5;
+static uint8_t pinLatch[2];
+static unsigned long pinModeCalls;
+
+static void setPinMode(uint8_t pin, uint8_t mode)
+{
+	++pinModeCalls;
+	uint8_t level = (mode == OUTPUT ? pinLatch[pin == sclPin] : HIGH);
+	if (pin == sdaPin)
+		bus.setMasterSda(level);
+	else if (pin == sclPin)
+		bus.setMasterScl(level);
+}
+
+static void writePin(uint8_t pin, uint8_t val)
+{
+	if (pin == sdaPin || pin == sclPin)
+		pinLatch[pin == sclPin] = val;
+}
+
+static int readPin(uint8_t pin)
+{
+	if (pin == sdaPin)
+		return bus.readSda();
+	if (pin == sclPin)
+		return bus.readScl();
+	return HIGH;
+}
+
+
+static void testPinDrivers(void)
+{
+	setUp();
+	hostPinMode = setPinMode;
+	hostDigitalWrite = writePin;
+	hostDigitalRead = readPin;
+	pinModeCalls = 0;
+
+	SoftWire pins(sdaPin, sclPin);
+	pins.setDelay_us(1);
+	pins.begin();
+	CHECK(pinModeCalls >= 2);
+	CHECK(busIdle());
+
+	uint8_t reg = 2;
+	uint8_t data[3];
+	CHECK_EQUAL(SoftWire::ack, pins.readRegister(0x40, &reg, 1, data, sizeof(data)));
+	CHECK_MEMORY(&registers[2], data, sizeof(data));
+	CHECK(busIdle());
+
+	hostPinMode = NULL;
+	hostDigitalWrite = NULL;
+	hostDigitalRead = NULL;
+}
+
+
+int main(void)
+{
+	bus.addDevice(sensor);
+	bus.addDevice(other);
+	bus.attach(sw);
+	sw.begin();
+
+	RUN_TEST(testReadRegister);
+	RUN_TEST(testLineEdges);
+	RUN_TEST(testWriteRegister);
+	RUN_TEST(testNack);
+	RUN_TEST(testScan);
+	RUN_TEST(testClockStretch);
+	RUN_TEST(testStretchTimeout);
+	RUN_TEST(testTransactionTimeout);
+	RUN_TEST(testTransactionDeadline);
+	RUN_TEST(testRecoverBus);
+	RUN_TEST(testSclStuck);
+	RUN_TEST(testTransfer);
+	RUN_TEST(testQueue);
+	RUN_TEST(testWire);
+	RUN_TEST(testSpans);
+	RUN_TEST(testPinDrivers);
+	return testSummary("test_softwire");
+}
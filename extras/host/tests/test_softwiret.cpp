@@ -0,0 +1,115 @@
+// SoftWireT on the simulated bus, through a backend which maps its two
+// pins onto SoftWireSim.
+
+#include <SoftWireT.h>
+#include <SoftWireSim.h>
+#include "test.h"
+
+uint8_t registers[16];
+
+SoftWireSim bus;
+SoftWireSimRegisters sensor(0x40, registers, sizeof(registers));
+bool sclStuck = false;
+
+const uint8_t sdaPin = 0;
+const uint8_t sclPin = 1;
+
+
+class SimBackend {
+public:
+	template <uint8_t pin> static inline void low(void) {
+		if (pin == sdaPin)
+			bus.setMasterSda(LOW);
+		else
+			bus.setMasterScl(LOW);
+	}
+
+	template <uint8_t pin> static inline void release(void) {
+		if (pin == sdaPin)
+			bus.setMasterSda(HIGH);
+		else
+			bus.setMasterScl(HIGH);
+	}
+
+	template <uint8_t pin> static inline uint8_t read(void) {
+		if (pin == sdaPin)
+			return bus.readSda();
+		return (sclStuck ? LOW : bus.readScl());
+	}
+};
+
+SoftWireT<sdaPin, sclPin, SimBackend> swt;
+
+
+static void setUp(void)
+{
+	for (uint8_t i = 0; i < sizeof(registers); ++i)
+		registers[i] = 0x10 + i;
+	sensor.setStretch(0);
+	sclStuck = false;
+	swt.setDelay_us(1);
+	swt.setTimeout_ms(1);
+	bus.resetStats();
+}
+
+
+static void testReadRegister(void)
+{
+	setUp();
+	uint8_t a, b;
+	CHECK_EQUAL(SoftWire::ack, swt.startWrite(0x40));
+	CHECK_EQUAL(SoftWire::ack, swt.llWrite(3));
+	CHECK_EQUAL(SoftWire::ack, swt.repeatedStartRead(0x40));
+	CHECK_EQUAL(SoftWire::ack, swt.readThenAck(a));
+	CHECK_EQUAL(SoftWire::ack, swt.readThenNack(b));
+	CHECK_EQUAL(SoftWire::ack, swt.stop());
+	CHECK_EQUAL(0x13, a);
+	CHECK_EQUAL(0x14, b);
+	CHECK_EQUAL(2, bus.getStats().starts);
+	CHECK_EQUAL(1, bus.getStats().stops);
+	CHECK(bus.getSda() == HIGH && bus.getScl() == HIGH);
+}
+
+
+static void testWriteAndNack(void)
+{
+	setUp();
+	sensor.setStretch(20);
+	CHECK_EQUAL(SoftWire::ack, swt.startWrite(0x40));
+	CHECK_EQUAL(SoftWire::ack, swt.llWrite(5));
+	CHECK_EQUAL(SoftWire::ack, swt.llWrite(0xC5));
+	CHECK_EQUAL(SoftWire::ack, swt.stop());
+	CHECK_EQUAL(0xC5, registers[5]);
+
+	CHECK_EQUAL(SoftWire::nack, swt.startWrite(0x41));
+	CHECK_EQUAL(SoftWire::ack, swt.stop());
+	CHECK(bus.getSda() == HIGH && bus.getScl() == HIGH);
+}
+
+
+// stop() and the functions which call it must return when SCL never
+// rises
+static void testSclStuck(void)
+{
+	setUp();
+	sclStuck = true;
+	CHECK_EQUAL(SoftWire::timedOut, swt.startWrite(0x40));
+	CHECK_EQUAL(SoftWire::timedOut, swt.stop());
+	swt.begin();
+	sclStuck = false;
+	CHECK_EQUAL(SoftWire::ack, swt.stop());
+	CHECK_EQUAL(SoftWire::ack, swt.startWrite(0x40));
+	CHECK_EQUAL(SoftWire::ack, swt.stop());
+}
+
+
+int main(void)
+{
+	bus.addDevice(sensor);
+	swt.begin();
+
+	RUN_TEST(testReadRegister);
+	RUN_TEST(testWriteAndNack);
+	RUN_TEST(testSclStuck);
+	return testSummary("test_softwiret");
+}
@@ -0,0 +1,268 @@
+// Bus timing: conversion of nanoseconds to delay cycles, the timing
+// presets selected by setClock(), and the compensation for line driver
+// overhead measured by calibrate(). F_CPU is not defined on the host, so
+// the delays are made in whole microseconds.
+
+#include <SoftWire.h>
+#include <SoftWireSim.h>
+#include "test.h"
+
+uint8_t sclLevel = HIGH;
+
+
+// Line drivers which take 1 us for each bit clocked by calibrate()
+static void slowSclLow(const SoftWire * /* p */)
+{
+	sclLevel = LOW;
+	++hostMicros;
+}
+
+
+static void slowSclHigh(const SoftWire * /* p */)
+{
+	sclLevel = HIGH;
+}
+
+
+static void slowSda(const SoftWire * /* p */)
+{
+	;
+}
+
+
+static uint8_t slowReadScl(const SoftWire * /* p */)
+{
+	return sclLevel;
+}
+
+
+static uint8_t slowReadSda(const SoftWire * /* p */)
+{
+	return HIGH;
+}
+
+
+static void useSlowDrivers(SoftWire &sw)
+{
+	sw.setSetSdaLow(slowSda);
+	sw.setSetSdaHigh(slowSda);
+	sw.setSetSclLow(slowSclLow);
+	sw.setSetSclHigh(slowSclHigh);
+	sw.setReadSda(slowReadSda);
+	sw.setReadScl(slowReadScl);
+}
+
+
+static void testNsToCycles(void)
+{
+	// Rounded up, so that no delay is shorter than requested
+	CHECK_EQUAL(0, SoftWire::nsToCycles(0));
+	CHECK_EQUAL(1, SoftWire::nsToCycles(1));
+	CHECK_EQUAL(1, SoftWire::nsToCycles(999));
+	CHECK_EQUAL(1, SoftWire::nsToCycles(1000));
+	CHECK_EQUAL(2, SoftWire::nsToCycles(1001));
+	CHECK_EQUAL(5, SoftWire::nsToCycles(4700));
+	CHECK_EQUAL(255, SoftWire::nsToCycles(255000));
+}
+
+
+static void testDelayCycles(void)
+{
+	unsigned long start = hostMicros;
+	SoftWire::delayCycles(0);
+	CHECK_EQUAL(0, hostMicros - start);
+
+	start = hostMicros;
+	SoftWire::delayCycles(7);
+	CHECK_EQUAL(7, hostMicros - start);
+}
+
+
+static void testSetDelay(void)
+{
+	SoftWire sw(0, 1);
+
+	sw.setDelay_ns(1500);
+	CHECK_EQUAL(1500, sw.getDelay_ns());
+	CHECK_EQUAL(2, sw.getDelay_us()); // Rounded to nearest
+	CHECK_EQUAL(1500, sw.getTiming().low_ns);
+	CHECK_EQUAL(1500, sw.getTiming().buf_ns);
+
+	sw.setDelay_us(3);
+	CHECK_EQUAL(3000, sw.getDelay_ns());
+	CHECK_EQUAL(3, sw.getDelay_us());
+}
+
+
+static void testTimingToCycles(void)
+{
+	SoftWire::timingCycles_t cycles;
+
+	// SDA changes tSU;DAT before the end of tLOW
+	SoftWire::timingToCycles(SoftWire::standardMode, cycles);
+	CHECK_EQUAL(5, cycles.hdDat); // 4450 ns
+	CHECK_EQUAL(1, cycles.suDat);
+	CHECK_EQUAL(4, cycles.high);
+	CHECK_EQUAL(4, cycles.hdSta);
+	CHECK_EQUAL(5, cycles.suSta);
+	CHECK_EQUAL(4, cycles.suSto);
+	CHECK_EQUAL(5, cycles.buf);
+
+	// tSU;DAT is limited to tLOW
+	SoftWire::timing_t timing = SoftWire::fastModePlus;
+	timing.low_ns = 40;
+	SoftWire::timingToCycles(timing, cycles);
+	CHECK_EQUAL(0, cycles.hdDat);
+	CHECK_EQUAL(1, cycles.suDat);
+}
+
+
+static void checkPreset(const SoftWire &sw, const SoftWire::timing_t &preset)
+{
+	const SoftWire::timing_t &timing = sw.getTiming();
+	CHECK_EQUAL(preset.suDat_ns, timing.suDat_ns);
+	CHECK_EQUAL(preset.hdSta_ns, timing.hdSta_ns);
+	CHECK_EQUAL(preset.suSta_ns, timing.suSta_ns);
+	CHECK_EQUAL(preset.suSto_ns, timing.suSto_ns);
+	CHECK_EQUAL(preset.buf_ns, timing.buf_ns);
+}
+
+
+static void testSetClockPresets(void)
+{
+	SoftWire sw(0, 1);
+
+	sw.setClock(100000);
+	checkPreset(sw, SoftWire::standardMode);
+	sw.setClock(100001);
+	checkPreset(sw, SoftWire::fastMode);
+	sw.setClock(400000);
+	checkPreset(sw, SoftWire::fastMode);
+	sw.setClock(400001);
+	checkPreset(sw, SoftWire::fastModePlus);
+	sw.setClock(1000000);
+	checkPreset(sw, SoftWire::fastModePlus);
+
+	// Ignored
+	sw.setClock(0);
+	checkPreset(sw, SoftWire::fastModePlus);
+}
+
+
+static void testSetClockRatio(void)
+{
+	SoftWire sw(0, 1);
+
+	// The period is shared in the ratio tLOW:tHIGH of the preset
+	sw.setClock(100000); // 4700:4000 of 10000 ns
+	CHECK_EQUAL(5402, sw.getTiming().low_ns);
+	CHECK_EQUAL(4598, sw.getTiming().high_ns);
+
+	sw.setClock(400000); // 1300:600 of 2500 ns
+	CHECK_EQUAL(1710, sw.getTiming().low_ns);
+	CHECK_EQUAL(790, sw.getTiming().high_ns);
+
+	sw.setClock(1000000); // 500:260 of 1000 ns
+	CHECK_EQUAL(657, sw.getTiming().low_ns);
+	CHECK_EQUAL(343, sw.getTiming().high_ns);
+
+	// Lower frequencies lengthen tLOW and tHIGH only
+	sw.setClock(50000);
+	CHECK_EQUAL(10804, sw.getTiming().low_ns);
+	CHECK_EQUAL(9196, sw.getTiming().high_ns);
+	checkPreset(sw, SoftWire::standardMode);
+}
+
+
+static void testCalibrate(void)
+{
+	SoftWire sw(0, 1);
+	useSlowDrivers(sw);
+
+	// 64 bits of 1 us, plus 1 us for reading the clock, in 128 half-bits
+	sw.calibrate();
+	CHECK_EQUAL(507, sw.getOverhead_ns());
+
+	// Re-applied by calibrate()
+	sw.setClock(400000);
+	CHECK_EQUAL(1710 - 507, sw.getTiming().low_ns);
+	CHECK_EQUAL(790 - 507, sw.getTiming().high_ns);
+	sw.calibrate();
+	CHECK_EQUAL(1710 - 507, sw.getTiming().low_ns);
+	CHECK_EQUAL(790 - 507, sw.getTiming().high_ns);
+
+	// Not reduced below zero
+	sw.setClock(1000000);
+	CHECK_EQUAL(657 - 507, sw.getTiming().low_ns);
+	CHECK_EQUAL(0, sw.getTiming().high_ns);
+	checkPreset(sw, SoftWire::fastModePlus);
+
+	// Not applied when the timing is set directly
+	sw.setDelay_ns(2000);
+	CHECK_EQUAL(2000, sw.getTiming().low_ns);
+	sw.calibrate();
+	CHECK_EQUAL(2000, sw.getTiming().high_ns);
+}
+
+
+static void testGetClock(void)
+{
+	SoftWire sw(0, 1);
+
+	// tLOW and tHIGH are each rounded up to whole microseconds
+	sw.setDelay_us(5);
+	CHECK_EQUAL(100000, sw.getClock());
+	sw.setDelay_ns(1500);
+	CHECK_EQUAL(250000, sw.getClock()); // 2 + 2 us
+	sw.setClock(100000);
+	CHECK_EQUAL(83333, sw.getClock()); // 6 + 1 + 5 us
+	sw.setClock(400000);
+	CHECK_EQUAL(250000, sw.getClock()); // 2 + 1 + 1 us
+	sw.setClock(1000000);
+	CHECK_EQUAL(333333, sw.getClock()); // 1 + 1 + 1 us
+
+	// The overhead is added to each half-bit
+	useSlowDrivers(sw);
+	sw.calibrate();
+	sw.setClock(400000);
+	CHECK_EQUAL(199441, sw.getClock()); // 2 + 1 + 1 us + 2 * 507 ns
+	sw.setDelay_us(5);
+	CHECK_EQUAL(90793, sw.getClock()); // 10 us + 2 * 507 ns
+
+	sw.setDelay_ns(0);
+	CHECK_EQUAL(986193, sw.getClock());
+}
+
+
+static void testClockOnBus(void)
+{
+	SoftWireSim bus;
+	SoftWire sw(0, 1);
+	bus.attach(sw);
+
+	// The period of each bit matches getClock()
+	sw.setClock(100000);
+	sw.begin();
+	CHECK_EQUAL(SoftWire::nack, sw.startWrite(0x40));
+	unsigned long start = hostMicros;
+	sw.llWrite(0xFF);
+	unsigned long elapsed = hostMicros - start;
+	sw.stop();
+	CHECK(elapsed >= 9 * 1000000UL / sw.getClock());
+	CHECK(elapsed <= 9 * 1000000UL / sw.getClock() + 2);
+}
+
+
+int main(void)
+{
+	RUN_TEST(testNsToCycles);
+	RUN_TEST(testDelayCycles);
+	RUN_TEST(testSetDelay);
+	RUN_TEST(testTimingToCycles);
+	RUN_TEST(testSetClockPresets);
+	RUN_TEST(testSetClockRatio);
+	RUN_TEST(testCalibrate);
+	RUN_TEST(testGetClock);
+	RUN_TEST(testClockOnBus);
+	return testSummary("test_timing");
+}
@@ -8,7 +8,63 @@
 #include <util/atomic.h>
 #endif
 
+#if defined(__AVR__)
+#include <util/delay_basic.h>
+#endif
+
 #include <SoftWire.h>
+#include <SoftWireSequencer.h>
+
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+
+#ifndef pgm_read_byte
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#endif
+
+// CRC-8 (polynomial x^8 + x^2 + x + 1) of each byte value
+static const uint8_t crc8Table[256] PROGMEM = {
+	0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+	0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+	0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65,
+	0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+	0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5,
+	0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+	0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85,
+	0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+	0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2,
+	0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+	0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2,
+	0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+	0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32,
+	0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+	0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42,
+	0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+	0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C,
+	0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+	0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC,
+	0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+	0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C,
+	0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+	0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C,
+	0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+	0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B,
+	0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+	0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B,
+	0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+	0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB,
+	0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+	0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB,
+	0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3,
+};
+
+// CRC-8 remainder after shifting each nibble value out of the most
+// significant nibble
+static const uint8_t crc8NibbleTable[16] PROGMEM = {
+	0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+	0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+};
 
 
 // Force SDA low
@@ -69,9 +125,97 @@ uint8_t SoftWire::readScl(const SoftWire *p)
 }
 
 
+// Force SDA low using direct port access
+void SoftWire::sdaLowDirect(const SoftWire *p)
+{
+	const port_t &port = p->_sdaPort;
+
+#ifdef ATOMIC_BLOCK
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+	{
+		*port.output &= ~port.mask;
+		*port.mode |= port.mask;
+	}
+}
+
+
+// Release SDA to float high using direct port access
+void SoftWire::sdaHighDirect(const SoftWire *p)
+{
+	const port_t &port = p->_sdaPort;
+
+#ifdef ATOMIC_BLOCK
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+	{
+		*port.mode &= ~port.mask;
+		if (p->_inputMode == INPUT_PULLUP)
+			*port.output |= port.mask;
+	}
+}
+
+
+// Force SCL low using direct port access
+void SoftWire::sclLowDirect(const SoftWire *p)
+{
+	const port_t &port = p->_sclPort;
+
+#ifdef ATOMIC_BLOCK
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+	{
+		*port.output &= ~port.mask;
+		*port.mode |= port.mask;
+	}
+}
+
+
+// Release SCL to float high using direct port access
+void SoftWire::sclHighDirect(const SoftWire *p)
+{
+	const port_t &port = p->_sclPort;
+
+#ifdef ATOMIC_BLOCK
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+	{
+		*port.mode &= ~port.mask;
+		if (p->_inputMode == INPUT_PULLUP)
+			*port.output |= port.mask;
+	}
+}
+
+
+// Read SDA using direct port access
+uint8_t SoftWire::readSdaDirect(const SoftWire *p)
+{
+	return (*p->_sdaPort.input & p->_sdaPort.mask) ? HIGH : LOW;
+}
+
+
+// Read SCL using direct port access
+uint8_t SoftWire::readSclDirect(const SoftWire *p)
+{
+	return (*p->_sclPort.input & p->_sclPort.mask) ? HIGH : LOW;
+}
+
+
 // For testing the CRC-8 calculator may be useful:
 // http://smbus.org/faq/crc8Applet.htm
 uint8_t SoftWire::crc8_update(uint8_t crc, uint8_t data)
+{
+#if SOFTWIRE_CRC8_TABLE_SIZE == 256
+	return crc8_updateTable(crc, data);
+#elif SOFTWIRE_CRC8_TABLE_SIZE == 16
+	return crc8_updateNibble(crc, data);
+#else
+	return crc8_updateLoop(crc, data);
+#endif
+}
+
+
+uint8_t SoftWire::crc8_updateLoop(uint8_t crc, uint8_t data)
 {
 	const uint16_t polynomial = 0x107;
 	crc ^= data;
@@ -86,12 +230,132 @@ uint8_t SoftWire::crc8_update(uint8_t crc, uint8_t data)
 }
 
 
+uint8_t SoftWire::crc8_updateNibble(uint8_t crc, uint8_t data)
+{
+	crc ^= data;
+	crc = (crc << 4) ^ pgm_read_byte(&crc8NibbleTable[crc >> 4]);
+	crc = (crc << 4) ^ pgm_read_byte(&crc8NibbleTable[crc >> 4]);
+	return crc;
+}
+
+
+uint8_t SoftWire::crc8_updateTable(uint8_t crc, uint8_t data)
+{
+	return pgm_read_byte(&crc8Table[crc ^ data]);
+}
+
+
+#if defined(SOFTWIRE_CPU_HZ) && (defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__))
+// Cortex-M3/M4/M7 data watchpoint and trace unit cycle counter
+#define SOFTWIRE_DEMCR (*(volatile uint32_t*)0xE000EDFC)
+#define SOFTWIRE_DWT_CTRL (*(volatile uint32_t*)0xE0001000)
+#define SOFTWIRE_DWT_CYCCNT (*(volatile uint32_t*)0xE0001004)
+// Lock access register. The DWT is locked after reset on many Cortex-M7
+// parts (eg STM32F7 and STM32H7); where there is no lock the write is
+// ignored.
+#define SOFTWIRE_DWT_LAR (*(volatile uint32_t*)0xE0001FB0)
+#define SOFTWIRE_DWT_UNLOCK 0xC5ACCE55UL
+
+// Enable the cycle counter and check that it runs. Returns false if it
+// does not, in which case the delay loop is used instead.
+static bool startCycleCounter(void)
+{
+	SOFTWIRE_DEMCR |= (1UL << 24); // TRCENA
+	SOFTWIRE_DWT_LAR = SOFTWIRE_DWT_UNLOCK;
+	SOFTWIRE_DWT_CTRL |= 1;
+
+	uint32_t start = SOFTWIRE_DWT_CYCCNT;
+	for (volatile uint8_t i = 16; i; --i)
+		;
+	return SOFTWIRE_DWT_CYCCNT != start;
+}
+#endif
+
+void SoftWire::delayCycles(uint32_t cycles)
+{
+#if !defined(SOFTWIRE_CPU_HZ)
+	if (cycles)
+		delayMicroseconds(cycles);
+#elif defined(__AVR__)
+	// 4 cycles per iteration, a count of zero gives 65536 iterations
+	cycles >>= 2;
+	while (cycles > 0xFFFF) {
+		_delay_loop_2(0);
+		cycles -= 0x10000UL;
+	}
+	if (cycles)
+		_delay_loop_2(cycles);
+#elif defined(SOFTWIRE_DWT_CYCCNT)
+	// 0 = not yet checked, 1 = counter runs, 2 = use the delay loop
+	static uint8_t counterState = 0;
+	if (cycles == 0)
+		return;
+	if (counterState == 0)
+		counterState = (startCycleCounter() ? 1 : 2);
+	if (counterState == 2) {
+		for (volatile uint32_t i = cycles / SOFTWIRE_LOOP_CYCLES; i; --i)
+			;
+		return;
+	}
+	uint32_t start = SOFTWIRE_DWT_CYCCNT;
+	while (SOFTWIRE_DWT_CYCCNT - start < cycles)
+		;
+#elif defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+	uint32_t start = ESP.getCycleCount();
+	while (ESP.getCycleCount() - start < cycles)
+		;
+#else
+	for (volatile uint32_t i = cycles / SOFTWIRE_LOOP_CYCLES; i; --i)
+		;
+#endif
+}
+
+
+uint32_t SoftWire::nsToCycles(uint32_t ns)
+{
+#ifdef SOFTWIRE_CPU_HZ
+	return (uint64_t(ns) * SOFTWIRE_CPU_HZ + 500000000UL) / 1000000000UL;
+#else
+	return (ns + 999) / 1000;
+#endif
+}
+
+
+void SoftWire::timingToCycles(const timing_t &timing, timingCycles_t &cycles)
+{
+	uint32_t suDat_ns = (timing.suDat_ns < timing.low_ns ? timing.suDat_ns : timing.low_ns);
+	cycles.hdDat = nsToCycles(timing.low_ns - suDat_ns);
+	cycles.suDat = nsToCycles(suDat_ns);
+	cycles.high = nsToCycles(timing.high_ns);
+	cycles.hdSta = nsToCycles(timing.hdSta_ns);
+	cycles.suSta = nsToCycles(timing.suSta_ns);
+	cycles.suSto = nsToCycles(timing.suSto_ns);
+	cycles.buf = nsToCycles(timing.buf_ns);
+}
+
+
+// tLOW, tHIGH, tSU;DAT, tHD;STA, tSU;STA, tSU;STO, tBUF
+const SoftWire::timing_t SoftWire::standardMode = {4700, 4000, 250, 4000, 4700, 4000, 4700};
+const SoftWire::timing_t SoftWire::fastMode = {1300, 600, 100, 600, 600, 600, 1300};
+const SoftWire::timing_t SoftWire::fastModePlus = {500, 260, 50, 260, 260, 260, 500};
+
+
 SoftWire::SoftWire(uint8_t sda, uint8_t scl) :
 	_sda(sda),
 	_scl(scl),
 	_inputMode(INPUT), // Pullups disabled by default
-	_delay_us(defaultDelay_us),
-	_timeout_ms(defaultTimeout_ms),
+	_timeout_us(defaultTimeout_ms * uint32_t(1000)),
+	_transactionTimeout_us(0),
+	_transactionActive(false),
+	_phase(noPhase),
+	_timeoutPhase(noPhase),
+	_busStatus(busOk),
+	_frequency(0),
+	_overhead_ns(0),
+	_pecEnabled(false),
+	_pec(0),
+	_lines(0),
+	_timeoutChecks(0),
 	_rxBuffer(NULL),
 	_rxBufferSize(0),
 	_rxBufferIndex(0),
@@ -100,234 +364,487 @@ SoftWire::SoftWire(uint8_t sda, uint8_t scl) :
 	_txBuffer(NULL),
     _txBufferSize(0),
 	_txBufferIndex(0),
+	_txSpans(NULL),
+	_txNumSpans(0),
     _sdaLow(sdaLow),
 	_sdaHigh(sdaHigh),
 	_sclLow(sclLow),
 	_sclHigh(sclHigh),
 	_readSda(readSda),
-	_readScl(readScl)
+	_readScl(readScl),
+	_context(NULL),
+	_queue(NULL),
+	_queueSize(0),
+	_queueLength(0),
+	_resolvePorts(false)
 {
-	;
+	_sdaPort.mode = _sdaPort.output = _sdaPort.input = NULL;
+	_sdaPort.mask = 0;
+	_sclPort = _sdaPort;
+	setDelay_ns(defaultDelay_us * uint32_t(1000));
 }
 
 
-void SoftWire::begin(void) const
+void SoftWire::begin(void)
 {
+#ifdef SOFTWIRE_HAS_PORT_REGISTERS
+	if (_resolvePorts) {
+		if (resolvePort(_sda, _sdaPort) && resolvePort(_scl, _sclPort)) {
+			// Configure the pins once with the core. This enables the
+			// input buffer (SAMD) and the pullups (SAMD, megaAVR), which
+			// the direct drivers do not; they change only the direction
+			// and output registers.
+			pinMode(_sda, _inputMode);
+			pinMode(_scl, _inputMode);
+			useDirectDrivers();
+		}
+		else {
+			// Invalid pin, revert to the default functions
+			_resolvePorts = false;
+			_sdaLow = sdaLow;
+			_sdaHigh = sdaHigh;
+			_sclLow = sclLow;
+			_sclHigh = sclHigh;
+			_readSda = readSda;
+			_readScl = readScl;
+		}
+	}
+#endif
+
+	// Line levels are unknown until stop() has driven them
+	_lines = 0;
+	if (_frequency)
+		calibrate();
+
 	/*
 	// Release SDA and SCL
 	_sdaHigh(this);
 	delayMicroseconds(_delay_us);
 	_sclHigh(this);
 	*/
-	stop();
+	recoverBus();
 }
 
 
-SoftWire::result_t SoftWire::stop(void) const
+#ifdef SOFTWIRE_HAS_PORT_REGISTERS
+void SoftWire::useDirectPortAccess(void)
 {
-	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
+	_resolvePorts = true;
+}
 
-	// Force SCL low
-	_sclLow(this);
-	delayMicroseconds(_delay_us);
 
-	// Force SDA low
-	_sdaLow(this);
-	delayMicroseconds(_delay_us);
+bool SoftWire::resolvePort(uint8_t pin, port_t &port)
+{
+	if (pin >= NUM_DIGITAL_PINS)
+		return false;
+
+	uint8_t portNum = digitalPinToPort(pin);
+	port.mode = portModeRegister(portNum);
+	port.output = portOutputRegister(portNum);
+	port.input = portInputRegister(portNum);
+	port.mask = digitalPinToBitMask(pin);
+	return true;
+}
+#endif
 
-	// Release SCL
-	if (!sclHighAndStretch(timeout))
-		return timedOut;
-	delayMicroseconds(_delay_us);
 
-	// Release SDA
-	_sdaHigh(this);
-	delayMicroseconds(_delay_us);
+void SoftWire::setSdaPort(portReg_t *mode, portReg_t *output, portReg_t *input, portValue_t mask)
+{
+	_resolvePorts = false;
+	_sdaPort.mode = mode;
+	_sdaPort.output = output;
+	_sdaPort.input = input;
+	_sdaPort.mask = mask;
+	useDirectDrivers();
+}
 
-	return ack;
+
+void SoftWire::setSclPort(portReg_t *mode, portReg_t *output, portReg_t *input, portValue_t mask)
+{
+	_resolvePorts = false;
+	_sclPort.mode = mode;
+	_sclPort.output = output;
+	_sclPort.input = input;
+	_sclPort.mask = mask;
+	useDirectDrivers();
 }
 
-SoftWire::result_t SoftWire::llStart(uint8_t rawAddr) const
+
+void SoftWire::useDirectDrivers(void)
 {
+	_sdaLow = sdaLowDirect;
+	_sdaHigh = sdaHighDirect;
+	_sclLow = sclLowDirect;
+	_sclHigh = sclHighDirect;
+	_readSda = readSdaDirect;
+	_readScl = readSclDirect;
+}
 
-	// Force SDA low
-	_sdaLow(this);
-	delayMicroseconds(_delay_us);
 
-	// Force SCL low
-	_sclLow(this);
-	delayMicroseconds(_delay_us);
-	return llWrite(rawAddr);
+void SoftWire::calibrate(void)
+{
+	const uint8_t iterations = 64;
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+
+	// Time the line driver calls made for each bit of llWrite(), without
+	// the delays. SDA stays released so no start or stop is generated.
+	// The functions used always drive the lines.
+	sdaHigh();
+	unsigned long start = micros();
+	for (uint8_t i = iterations; i; --i) {
+		sclLow();
+		delayCycles(0);
+		sdaHigh();
+		delayCycles(0);
+		if (!sclHighAndStretch(timeout))
+			return; // Bus is held, keep the previous measurement
+		delayCycles(0);
+	}
+	unsigned long elapsed = micros() - start;
+
+	// Two half-bits per iteration
+	uint32_t overhead_ns = (elapsed * 1000UL) / (2 * iterations);
+	_overhead_ns = (overhead_ns > 0xFFFF ? 0xFFFF : overhead_ns);
+
+	if (_frequency)
+		setClock(_frequency);
 }
 
 
-SoftWire::result_t SoftWire::llRepeatedStart(uint8_t rawAddr) const
+SoftWire::busStatus_t SoftWire::recoverBus(void) const
 {
-	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	busStatus_t status = busOk;
+
+	// Release both lines, their previous state is not trusted
+	_lines = 0;
+	driveSda(HIGH);
+	driveScl(HIGH);
+	delayCycles(_cycles.high);
+
+	if (_readScl(this) == LOW)
+		return (_busStatus = sclStuck);
+
+	// A slave transmitting a zero holds SDA low, clock out the rest of
+	// its byte and the ACK bit
+	for (uint8_t i = 9; i && _readSda(this) == LOW; --i) {
+		status = busRecovered;
+		driveScl(LOW);
+		delayCycles(_cycles.hdDat + _cycles.suDat);
+		driveScl(HIGH);
+		if (_readScl(this) == LOW) {
+			timeout.restart();
+			while (_readScl(this) == LOW)
+				if (timeout.isExpired())
+					return (_busStatus = sclStuck);
+		}
+		delayCycles(_cycles.high);
+	}
 
-	// Force SCL low
-	_sclLow(this);
-	delayMicroseconds(_delay_us);
+	if (_readSda(this) == LOW)
+		return (_busStatus = sdaStuck);
+
+	if (stopInner(timeout) != ack)
+		return (_busStatus = sclStuck);
+	return (_busStatus = status);
+}
 
-	// Release SDA
-	_sdaHigh(this);
-	delayMicroseconds(_delay_us);
 
-	// Release SCL
-	if (!sclHighAndStretch(timeout))
+SoftWire::result_t SoftWire::stop(void) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	return stopInner(timeout);
+}
+
+
+SoftWire::result_t SoftWire::stopInner(AsyncDelay &timeout) const
+{
+	// Nothing to do if the bus has not been used since the last stop
+	if (_lines == busIdle) {
+		_transactionActive = false;
+		return ack;
+	}
+	_phase = stopPhase;
+
+	if (!SoftWireSequencer<SoftWire>(*this, _cycles).stop(timeout)) {
+		_transactionActive = false;
 		return timedOut;
-	delayMicroseconds(_delay_us);
+	}
 
-	// Force SDA low
-	_sdaLow(this);
-	delayMicroseconds(_delay_us);
+	_lines |= stopSent;
+	_transactionActive = false;
+	return ack;
+}
 
-	return llWrite(rawAddr);
+// Start the transaction deadline and clear the phase which timed out
+void SoftWire::beginTransaction(void) const
+{
+	_phase = startPhase;
+	_timeoutPhase = noPhase;
+	_transactionActive = (_transactionTimeout_us != 0);
+	if (_transactionActive)
+		_transactionTimeout.start(_transactionTimeout_us, AsyncDelay::MICROS);
 }
 
 
-SoftWire::result_t SoftWire::llStartWait(uint8_t rawAddr) const
+SoftWire::result_t SoftWire::llStart(uint8_t rawAddr) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	return llStartInner(rawAddr, timeout);
+}
+
+
+SoftWire::result_t SoftWire::llStartInner(uint8_t rawAddr, AsyncDelay &timeout) const
 {
-	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
-
-	while (!timeout.isExpired()) {
-		// Force SDA low
-		_sdaLow(this);
-		delayMicroseconds(_delay_us);
-
-		switch (llWrite(rawAddr)) {
-		case ack:
-			return ack;
-		case nack:
-			stop();
-		default:
-			// timeout, and anything else we don't know about
-			stop();
+	// Whilst the bus is stuck try to recover it first, and fail
+	// immediately if that is not possible
+	if (_busStatus == sdaStuck || _busStatus == sclStuck) {
+		busStatus_t status = recoverBus();
+		if (status == sdaStuck || status == sclStuck) {
+			_timeoutPhase = startPhase;
 			return timedOut;
 		}
 	}
-	return timedOut;
+
+	beginTransaction();
+	SoftWireSequencer<SoftWire>(*this, _cycles).start();
+	return llWriteByte(rawAddr, timeout);
 }
 
 
-SoftWire::result_t SoftWire::llWrite(uint8_t data) const
+SoftWire::result_t SoftWire::llRepeatedStart(uint8_t rawAddr) const
 {
-	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
-	for (uint8_t i = 8; i; --i) {
-		// Force SCL low
-		_sclLow(this);
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	return llRepeatedStartInner(rawAddr, timeout);
+}
 
-		if (data & 0x80) {
-			// Release SDA
-			_sdaHigh(this);
-		}
-		else {
-			// Force SDA low
-			_sdaLow(this);
-		}
-		delayMicroseconds(_delay_us);
 
-		// Release SCL
-		if (!sclHighAndStretch(timeout))
-			return timedOut;
+SoftWire::result_t SoftWire::llRepeatedStartInner(uint8_t rawAddr, AsyncDelay &timeout) const
+{
+	_phase = repeatedStartPhase;
+	if (!SoftWireSequencer<SoftWire>(*this, _cycles).repeatedStart(timeout))
+		return timedOut;
+	return llWriteByte(rawAddr, timeout);
+}
 
-		delayMicroseconds(_delay_us);
 
-		data <<= 1;
-		if (timeout.isExpired()) {
-			stop(); // Reset bus
-			return timedOut;
-		}
+SoftWire::result_t SoftWire::llStartWait(uint8_t rawAddr) const
+{
+	result_t r = llStartPoll(rawAddr, 0, _timeout_us);
+	return (r == nack ? timedOut : r);
+}
+
+
+SoftWire::result_t SoftWire::llStartPoll(uint8_t rawAddr, uint32_t interval_us, uint32_t deadline_us) const
+{
+	AsyncDelay deadline(deadline_us, AsyncDelay::MICROS);
+	AsyncDelay interval;
+	uint8_t pec = _pec;
+
+	while (true) {
+		// Only the address of the attempt which succeeds is in the PEC
+		_pec = pec;
+		result_t r = llStart(rawAddr);
+		if (r != nack)
+			return r; // Acknowledged, or SCL held low
+		stop();
+
+		interval.start(interval_us, AsyncDelay::MICROS);
+		do {
+			if (deadline.isExpired()) {
+				_pec = pec;
+				return nack;
+			}
+		} while (!interval.isExpired());
 	}
+}
 
-	// Get ACK
-	// Force SCL low
-	_sclLow(this);
 
-	// Release SDA
-	_sdaHigh(this);
+SoftWire::result_t SoftWire::llWrite(uint8_t data) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	_phase = writePhase;
+	return llWriteByte(data, timeout);
+}
 
-	delayMicroseconds(_delay_us);
 
-	// Release SCL
-	if (!sclHighAndStretch(timeout))
-		return timedOut;
+SoftWire::result_t SoftWire::llRead(uint8_t &data, bool sendAck) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	_phase = readPhase;
+	return llReadByte(data, sendAck, timeout);
+}
 
-	result_t res = (_readSda(this) == LOW ? ack : nack);
 
-	delayMicroseconds(_delay_us);
+SoftWire::result_t SoftWire::llWriteBuffer(const uint8_t *data, size_t len) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	return llWriteBufferInner(data, len, timeout);
+}
 
-	// Keep SCL low between bytes
-	_sclLow(this);
 
-	return res;
+SoftWire::result_t SoftWire::llReadBuffer(uint8_t *data, size_t len, bool nackLast,
+										  size_t *count) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	return llReadBufferInner(data, len, nackLast, timeout, count);
 }
 
 
-SoftWire::result_t SoftWire::llRead(uint8_t &data, bool sendAck) const
+SoftWire::result_t SoftWire::readRegister(uint8_t addr, const uint8_t *reg, size_t regLen,
+										  uint8_t *out, size_t n) const
 {
-	data = 0;
-	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+
+	result_t r = llStartInner((addr << 1) + writeMode, timeout);
+	if (r == ack)
+		r = llWriteBufferInner(reg, regLen, timeout);
+	if (r == ack)
+		r = llRepeatedStartInner((addr << 1) + readMode, timeout);
+	if (r == ack)
+		r = llReadBufferInner(out, n, true, timeout);
+
+	result_t s = stopInner(timeout);
+	return (r == ack ? s : r);
+}
 
-	for (uint8_t i = 8; i; --i) {
-		data <<= 1;
 
-		// Force SCL low
-		_sclLow(this);
+SoftWire::result_t SoftWire::writeRegister(uint8_t addr, const uint8_t *reg, size_t regLen,
+										   const uint8_t *data, size_t n) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
 
-		// Release SDA (from previous ACK)
-		_sdaHigh(this);
-		delayMicroseconds(_delay_us);
+	result_t r = llStartInner((addr << 1) + writeMode, timeout);
+	if (r == ack)
+		r = llWriteBufferInner(reg, regLen, timeout);
+	if (r == ack)
+		r = llWriteBufferInner(data, n, timeout);
 
-		// Release SCL
-		if (!sclHighAndStretch(timeout))
-			return timedOut;
-		delayMicroseconds(_delay_us);
+	result_t s = stopInner(timeout);
+	return (r == ack ? s : r);
+}
 
-		// Read clock stretch
-		while (_readScl(this) == LOW)
-			if (timeout.isExpired()) {
-				stop(); // Reset bus
-				return timedOut;
-			}
 
-		if (_readSda(this))
-			data |= 1;
+SoftWire::result_t SoftWire::transfer(uint8_t addr, const segment_t *segs, uint8_t n) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	result_t r = ack;
+
+	for (uint8_t i = 0; i < n && r == ack; ++i) {
+		const segment_t &seg = segs[i];
+		uint8_t rawAddr = (addr << 1) + seg.mode;
+		if (i == 0)
+			r = llStartInner(rawAddr, timeout);
+		else if (seg.mode != segs[i - 1].mode)
+			r = llRepeatedStartInner(rawAddr, timeout);
+		if (r != ack)
+			break;
+
+		if (seg.mode == writeMode)
+			r = llWriteBufferInner(seg.txData, seg.len, timeout);
+		else {
+			// NACK the last byte unless a following read segment has data
+			bool nackLast = true;
+			for (uint8_t j = i + 1; j < n && segs[j].mode == readMode; ++j)
+				if (segs[j].len) {
+					nackLast = false;
+					break;
+				}
+			r = llReadBufferInner(seg.rxData, seg.len, nackLast, timeout);
+		}
 	}
 
+	result_t s = stopInner(timeout);
+	return (r == ack ? s : r);
+}
+
 
-	// Put ACK/NACK
+SoftWire::result_t SoftWire::scan(uint8_t *bitmap, uint8_t first, uint8_t last,
+								  uint16_t gap_us) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+
+	memset(bitmap, 0, 16);
+	if (last > 0x7F)
+		last = 0x7F;
+	for (uint16_t addr = first; addr <= last; ++addr) {
+		result_t r = llStartInner((addr << 1) + writeMode, timeout);
+		result_t s = stopInner(timeout);
+		if (r == timedOut || s == timedOut)
+			return timedOut;
+		if (r == ack)
+			bitmap[addr >> 3] |= (1 << (addr & 7));
 
-	// Force SCL low
-	_sclLow(this);
-	if (sendAck) {
-		// Force SDA low
-		_sdaLow(this);
+		if (gap_us && addr != last)
+			delayMicroseconds(gap_us);
 	}
-	else {
-		// Release SDA
-		_sdaHigh(this);
+	return ack;
+}
+
+
+SoftWire::result_t SoftWire::llWriteBufferInner(const uint8_t *data, size_t len, AsyncDelay &timeout) const
+{
+	_phase = writePhase;
+	for (size_t i = 0; i < len; ++i) {
+		result_t r = llWriteByte(data[i], timeout);
+		if (r != ack)
+			return r;
 	}
+	return ack;
+}
 
-	delayMicroseconds(_delay_us);
 
-	// Release SCL
-	if (!sclHighAndStretch(timeout))
+SoftWire::result_t SoftWire::llReadBufferInner(uint8_t *data, size_t len, bool nackLast, AsyncDelay &timeout,
+											   size_t *count) const
+{
+	_phase = readPhase;
+	for (size_t i = 0; i < len; ++i) {
+		result_t r = llReadByte(data[i], !nackLast || i != len - 1, timeout);
+		if (r != ack) {
+			if (count)
+				*count = i;
+			return r;
+		}
+	}
+	if (count)
+		*count = len;
+	return ack;
+}
+
+
+SoftWire::result_t SoftWire::llWriteByte(uint8_t data, AsyncDelay &timeout) const
+{
+	// The timeout is only checked whilst SCL is stretched, so check the
+	// transaction deadline before every byte
+	if (deadlineExpired())
 		return timedOut;
-	delayMicroseconds(_delay_us);
 
-	// Wait for SCL to return high
-	while (_readScl(this) == LOW)
-		if (timeout.isExpired()) {
-			stop(); // Reset bus
-			return timedOut;
-		}
+	// SCL is low, update the PEC before clocking out the data
+	if (_pecEnabled)
+		_pec = crc8_update(_pec, data);
 
-	delayMicroseconds(_delay_us);
+	result_t res;
+	if (!SoftWireSequencer<SoftWire>(*this, _cycles).writeByte(data, res, timeout))
+		return timedOut;
+	return res;
+}
+
+
+SoftWire::result_t SoftWire::llReadByte(uint8_t &data, bool sendAck, AsyncDelay &timeout) const
+{
+	data = 0;
+	if (deadlineExpired()) {
+		// The slave may already be driving the next byte onto SDA
+		recoverBus();
+		return timedOut;
+	}
 
-	// Keep SCL low between bytes
-	_sclLow(this);
+	if (!SoftWireSequencer<SoftWire>(*this, _cycles).readByte(data, sendAck, timeout))
+		return timedOut;
 
+	// Update the PEC whilst SCL is low between bytes
+	if (_pecEnabled)
+		_pec = crc8_update(_pec, data);
 	return ack;
 }
 
@@ -340,7 +857,7 @@ int SoftWire::available(void)
 
 size_t SoftWire::write(uint8_t data)
 {
-    if (_txBufferIndex >= _txBufferSize) {
+    if (_txSpans || _txBufferIndex >= _txBufferSize) {
         setWriteError();
         return 0;
     }
@@ -385,18 +902,61 @@ void SoftWire::end(void)
     enablePullups(false);
     _sdaHigh(this);
     _sclHigh(this);
+    _lines = 0;
 }
 
 
 void SoftWire::setClock(uint32_t frequency)
 {
-    uint32_t period_us = uint32_t(1000000UL) / frequency;
-    if (period_us < 2)
-        period_us = 2;
-    else if (period_us > 2 * 255)
-        period_us = 2* 255;
+    if (frequency == 0)
+        return;
+
+    timing_t timing = (frequency <= 100000UL ? standardMode
+                       : (frequency <= 400000UL ? fastMode : fastModePlus));
+
+    // Share the period between tLOW and tHIGH in the ratio of the
+    // preset, then subtract the time taken by the line drivers
+    uint32_t period_ns = uint32_t(1000000000UL) / frequency;
+    uint32_t low_ns = uint64_t(period_ns) * timing.low_ns / (timing.low_ns + timing.high_ns);
+    uint32_t high_ns = period_ns - low_ns;
+    timing.low_ns = (low_ns > _overhead_ns ? low_ns - _overhead_ns : 0);
+    timing.high_ns = (high_ns > _overhead_ns ? high_ns - _overhead_ns : 0);
+
+    setTiming(timing);
+    _frequency = frequency;
+}
+
+
+void SoftWire::setDelay_ns(uint32_t delay_ns)
+{
+    timing_t timing;
+    timing.low_ns = timing.high_ns = timing.suDat_ns = delay_ns;
+    timing.hdSta_ns = timing.suSta_ns = timing.suSto_ns = timing.buf_ns = delay_ns;
+    setTiming(timing);
+}
+
+
+void SoftWire::setTiming(const timing_t &timing)
+{
+    _timing = timing;
+    timingToCycles(timing, _cycles);
+    _frequency = 0;
+}
 
-    setDelay_us(period_us / 2);
+
+uint32_t SoftWire::getClock(void) const
+{
+    // Use the delays as made, after rounding to whole cycles
+    uint32_t cycles = _cycles.hdDat + _cycles.suDat + _cycles.high;
+#ifdef SOFTWIRE_CPU_HZ
+    uint32_t period_ns = uint64_t(cycles) * 1000000000UL / SOFTWIRE_CPU_HZ;
+#else
+    uint32_t period_ns = cycles * 1000UL;
+#endif
+    period_ns += 2 * uint32_t(_overhead_ns);
+    if (period_ns == 0)
+        return 0;
+    return uint32_t(1000000000UL) / period_ns;
 }
 
 
@@ -404,12 +964,23 @@ void SoftWire::beginTransmission(uint8_t address)
 {
     _txAddress = address;
     _txBufferIndex = 0;
+    _txSpans = NULL;
+}
+
+
+void SoftWire::beginTransmission(uint8_t address, const span_t *spans, uint8_t numSpans)
+{
+    _txAddress = address;
+    _txBufferIndex = 0;
+    _txSpans = spans;
+    _txNumSpans = numSpans;
 }
 
 
 uint8_t SoftWire::endTransmission(uint8_t sendStop)
 {
     uint8_t r = endTransmissionInner();
+    _txSpans = NULL; // Don't keep pointers to the caller's memory
     if (sendStop)
         stop();
     return r;
@@ -424,13 +995,17 @@ uint8_t SoftWire::endTransmissionInner(void) const
     else if (r == timedOut)
         return 4;
 
-    for (uint8_t i = 0; i < _txBufferIndex; ++i) {
-        r = llWrite(_txBuffer[i]);
-        if (r == nack)
-            return 3;
-        else if (r == timedOut)
-            return 4;
+    if (_txSpans) {
+        AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+        for (uint8_t i = 0; i < _txNumSpans && r == ack; ++i)
+            r = llWriteBufferInner(_txSpans[i].data, _txSpans[i].len, timeout);
     }
+    else
+        r = llWriteBuffer(_txBuffer, _txBufferIndex);
+    if (r == nack)
+        return 3;
+    else if (r == timedOut)
+        return 4;
 
     return 0;
 }
@@ -439,20 +1014,21 @@ uint8_t SoftWire::endTransmissionInner(void) const
 
 
 uint8_t SoftWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop)
+{
+    return requestFrom(address, size_t(quantity), bool(sendStop));
+}
+
+
+size_t SoftWire::requestFrom(uint8_t address, size_t quantity, bool sendStop)
 {
     _rxBufferIndex = 0;
     _rxBufferBytesRead = 0;
-    if (start(address, readMode) == 0) {
-        for (uint8_t i = 0; i < quantity; ++i) {
-            if (i >= _rxBufferSize)
-                break; // Don't write beyond buffer
-            result_t res = llRead(_rxBuffer[i], i != (quantity - 1));
-            if (res != ack)
-                break;
-
-            ++_rxBufferBytesRead;
-        }
-    }
+    if (quantity > _rxBufferSize)
+        quantity = _rxBufferSize; // Don't write beyond buffer
+
+    // Keep the bytes read before any error
+    if (start(address, readMode) == ack)
+        llReadBuffer(_rxBuffer, quantity, true, &_rxBufferBytesRead);
 
     if (sendStop)
         stop();
@@ -461,3 +1037,79 @@ uint8_t SoftWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t sendSto
 }
 
 
+bool SoftWire::enqueueRead(uint8_t addr, uint8_t *data, size_t len)
+{
+    transaction_t *t = enqueue(addr, readMode, len);
+    if (t == NULL)
+        return false;
+    t->rxData = data;
+    return true;
+}
+
+
+bool SoftWire::enqueueWrite(uint8_t addr, const uint8_t *data, size_t len)
+{
+    transaction_t *t = enqueue(addr, writeMode, len);
+    if (t == NULL)
+        return false;
+    t->txData = data;
+    return true;
+}
+
+
+// Next free descriptor, or NULL if the queue is full
+SoftWire::transaction_t* SoftWire::enqueue(uint8_t addr, mode_t mode, size_t len)
+{
+    if (_queueLength >= _queueSize)
+        return NULL;
+
+    transaction_t &t = _queue[_queueLength++];
+    t.addr = addr;
+    t.mode = mode;
+    t.txData = NULL;
+    t.rxData = NULL;
+    t.len = len;
+    t.result = ack;
+    return &t;
+}
+
+
+SoftWire::result_t SoftWire::execute(void)
+{
+    AsyncDelay timeout;
+    result_t firstError = ack;
+    bool started = false;
+
+    for (uint8_t i = 0; i < _queueLength; ++i) {
+        transaction_t &t = _queue[i];
+        timeout.start(_timeout_us, AsyncDelay::MICROS);
+
+        uint8_t rawAddr = (t.addr << 1) + t.mode;
+        result_t r;
+        if (started)
+            r = llRepeatedStartInner(rawAddr, timeout);
+        else
+            r = llStartInner(rawAddr, timeout);
+        started = true;
+
+        if (r == ack) {
+            if (t.mode == writeMode)
+                r = llWriteBufferInner(t.txData, t.len, timeout);
+            else
+                r = llReadBufferInner(t.rxData, t.len, true, timeout);
+        }
+
+        t.result = r;
+        if (r != ack && firstError == ack)
+            firstError = r;
+
+        // Keep the bus only if the next transaction is to the same device
+        if (r != ack || i + 1 == _queueLength || _queue[i + 1].addr != t.addr) {
+            stopInner(timeout);
+            started = false;
+        }
+    }
+
+    _queueLength = 0;
+    return firstError;
+}
@@ -8,6 +8,42 @@
 #include <Wire.h>
 #include <AsyncDelay.h>
 
+// Direct port access requires the width of the port registers. Where the
+// core also provides the pin to port mapping functions the registers can
+// be resolved automatically from the pin numbers.
+#if defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_MEGAAVR)
+#define SOFTWIRE_PORT_REG_TYPE uint8_t
+#define SOFTWIRE_HAS_PORT_REGISTERS
+#elif defined(ARDUINO_ARCH_SAMD)
+#define SOFTWIRE_PORT_REG_TYPE uint32_t
+#define SOFTWIRE_HAS_PORT_REGISTERS
+#else
+#define SOFTWIRE_PORT_REG_TYPE uint32_t
+#endif
+
+// Implementation used by SoftWire::crc8_update(): 0 selects the bitwise
+// loop, 16 a 16-entry nibble table and 256 a 256-entry table. The tables
+// are stored in PROGMEM.
+#ifndef SOFTWIRE_CRC8_TABLE_SIZE
+#define SOFTWIRE_CRC8_TABLE_SIZE 16
+#endif
+
+// CPU clock frequency, used to convert delays to CPU cycles. Where it is
+// not known delays are rounded up to whole microseconds.
+#if !defined(SOFTWIRE_CPU_HZ) && defined(F_CPU)
+#define SOFTWIRE_CPU_HZ F_CPU
+#endif
+
+// CPU cycles taken by each iteration of the generic delay loop, used on
+// architectures without a cycle counter
+#ifndef SOFTWIRE_LOOP_CYCLES
+#define SOFTWIRE_LOOP_CYCLES 4
+#endif
+
+// Set to 1 to count the number of timeout checks, for benchmarking
+#ifndef SOFTWIRE_STATS
+#define SOFTWIRE_STATS 0
+#endif
 
 class SoftWire : public TwoWire {
 public:
@@ -22,6 +58,93 @@ public:
 		readMode = 1,
 	};
 
+	// Result of recoverBus()
+	enum busStatus_t {
+		busOk = 0, // Lines were released, a stop was sent
+		busRecovered, // SDA was released by clocking SCL, a stop was sent
+		sdaStuck, // SDA still held low after 9 clocks
+		sclStuck, // SCL held low
+	};
+
+	// Part of a transaction in which a timeout occurred
+	enum phase_t {
+		noPhase = 0,
+		startPhase, // Start and address
+		repeatedStartPhase, // Repeated start and address
+		writePhase,
+		readPhase,
+		stopPhase,
+	};
+
+	typedef SOFTWIRE_PORT_REG_TYPE portValue_t;
+	typedef volatile portValue_t portReg_t;
+
+	// Registers and bitmask used for direct port access to one line
+	struct port_t {
+		portReg_t *mode; // Direction register, bit set for output
+		portReg_t *output;
+		portReg_t *input;
+		portValue_t mask;
+	};
+
+	// Descriptor for a queued transaction
+	struct transaction_t {
+		uint8_t addr;
+		mode_t mode;
+		const uint8_t *txData; // writeMode, not modified
+		uint8_t *rxData; // readMode
+		size_t len;
+		result_t result;
+	};
+
+	// Bus timing in nanoseconds, named after the parameters in the I2C
+	// specification. Each is a minimum; the time taken by the line
+	// drivers is added.
+	struct timing_t {
+		uint32_t low_ns; // tLOW, SCL low period
+		uint32_t high_ns; // tHIGH, SCL high period
+		uint32_t suDat_ns; // tSU;DAT, SDA setup before SCL rises
+		uint32_t hdSta_ns; // tHD;STA, hold time after a (repeated) start
+		uint32_t suSta_ns; // tSU;STA, setup time for a repeated start
+		uint32_t suSto_ns; // tSU;STO, setup time for a stop
+		uint32_t buf_ns; // tBUF, bus free time between a stop and a start
+	};
+
+	// Bus timing converted to CPU cycles by timingToCycles()
+	struct timingCycles_t {
+		uint32_t hdDat; // Remainder of tLOW before SDA is changed
+		uint32_t suDat;
+		uint32_t high;
+		uint32_t hdSta;
+		uint32_t suSta;
+		uint32_t suSto;
+		uint32_t buf;
+	};
+
+	// Segment of a scatter-gather transfer. Create with
+	// segment_t::write(cmd, 1) or segment_t::read(buf, len); only the
+	// pointer for the segment's direction is used.
+	struct segment_t {
+		mode_t mode;
+		const uint8_t *txData; // writeMode, not modified
+		uint8_t *rxData; // readMode
+		size_t len;
+
+		static inline segment_t write(const uint8_t *data, size_t len);
+		static inline segment_t read(uint8_t *data, size_t len);
+	};
+
+	// Caller-owned block of data for zero-copy transmission
+	struct span_t {
+		const uint8_t *data;
+		size_t len;
+	};
+
+	// Minimum timings from the I2C specification
+	static const timing_t standardMode; // 100 kHz
+	static const timing_t fastMode; // 400 kHz
+	static const timing_t fastModePlus; // 1 MHz
+
 	static const uint8_t defaultDelay_us = 10;
 	static const uint16_t defaultTimeout_ms = 100;
 
@@ -32,14 +155,38 @@ public:
 	static uint8_t readSda(const SoftWire *p);
 	static uint8_t readScl(const SoftWire *p);
 
-	// SMBus uses CRC-8 for its PEC
+	// Line drivers which access the port registers directly
+	static void sdaLowDirect(const SoftWire *p);
+	static void sdaHighDirect(const SoftWire *p);
+	static void sclLowDirect(const SoftWire *p);
+	static void sclHighDirect(const SoftWire *p);
+	static uint8_t readSdaDirect(const SoftWire *p);
+	static uint8_t readSclDirect(const SoftWire *p);
+
+	// SMBus uses CRC-8 for its PEC. crc8_update() uses the implementation
+	// selected by SOFTWIRE_CRC8_TABLE_SIZE, the others are always available.
 	static uint8_t crc8_update(uint8_t crc, uint8_t data);
+	static uint8_t crc8_updateLoop(uint8_t crc, uint8_t data);
+	static uint8_t crc8_updateNibble(uint8_t crc, uint8_t data);
+	static uint8_t crc8_updateTable(uint8_t crc, uint8_t data);
+
+	// Busy-wait for a number of CPU cycles (microseconds if
+	// SOFTWIRE_CPU_HZ is not defined), and the conversion from
+	// nanoseconds
+	static void delayCycles(uint32_t cycles);
+	static uint32_t nsToCycles(uint32_t ns);
+	// SDA is changed part way through tLOW so that it is set up tSU;DAT
+	// before SCL rises
+	static void timingToCycles(const timing_t &timing, timingCycles_t &cycles);
 
 	SoftWire(uint8_t sda, uint8_t scl);
 	inline uint8_t getSda(void) const;
 	inline uint8_t getScl(void) const;
 	inline uint8_t getDelay_us(void) const;
+	inline uint32_t getDelay_ns(void) const;
 	inline uint16_t getTimeout_ms(void) const;
+	inline uint32_t getTimeout_us(void) const;
+	inline uint32_t getTransactionTimeout_us(void) const;
 	inline uint8_t getInputMode(void) const;
 
 	// begin() must be called after any changes are made to SDA and/or
@@ -48,12 +195,59 @@ public:
 	inline void setScl(uint8_t scl);
 	inline void enablePullups(bool enablePullups = true);
 
+	// The delay is used for every phase of the bus timing. Setting the
+	// delay or the timing directly cancels any frequency set by
+	// setClock(). getDelay_us() and getDelay_ns() return the mean of
+	// tLOW and tHIGH.
 	inline void setDelay_us(uint8_t delay_us);
+	void setDelay_ns(uint32_t delay_ns);
+	void setTiming(const timing_t &timing);
+	inline const timing_t& getTiming(void) const;
+	// The timeout limits how long a slave may hold SCL low. It is
+	// restarted at each clock stretch, and a slave may stretch every
+	// bit, so a byte can take up to nine times the timeout.
 	inline void setTimeout_ms(uint16_t timeout_ms);
+	inline void setTimeout_us(uint32_t timeout_us);
+	// Deadline for a whole transaction, from the start up to the end of
+	// the stop, in addition to the timeout for each call. It is checked
+	// before every byte and whilst SCL is stretched. Zero disables.
+	inline void setTransactionTimeout_us(uint32_t timeout_us);
+	// Phase of the most recent transaction which timed out, or noPhase
+	// if it did not time out
+	inline phase_t getTimeoutPhase(void) const;
+
+	// Measure the time taken by the line drivers for each half-bit, so
+	// that setClock() can subtract it from tLOW and tHIGH. SCL is clocked with
+	// SDA released. Called by begin() if setClock() has been used.
+	void calibrate(void);
+	inline uint16_t getOverhead_ns(void) const;
+	// SCL frequency (Hz) achieved with the current timing, allowing for
+	// the overhead measured by calibrate() and the rounding of the delays
+	// to whole cycles (whole microseconds if SOFTWIRE_CPU_HZ is not
+	// defined)
+	uint32_t getClock(void) const;
+
+#if SOFTWIRE_STATS
+	inline uint32_t getTimeoutChecks(void) const {
+		return _timeoutChecks;
+	}
+	inline void resetTimeoutChecks(void) {
+		_timeoutChecks = 0;
+	}
+#endif
+
+	// When PEC is enabled every byte sent or received by the low-level
+	// functions, including addresses, is added to the PEC whilst it is
+	// being clocked. After a valid SMBus read including its PEC byte
+	// getPec() returns zero.
+	inline void enablePec(bool enable = true);
+	inline bool isPecEnabled(void) const;
+	inline void resetPec(void);
+	inline uint8_t getPec(void) const;
 
 	// begin() must be called before use, and after any changes are made
-	// to the SDA and/or SCL pins.
-	void begin(void) const;
+	// to the SDA and/or SCL pins. The bus is reset with recoverBus().
+	void begin(void);
     void end(void); // Restore pins to inputs
 
 	// Functions which take raw addresses (ie address passed must
@@ -61,9 +255,26 @@ public:
 	result_t llStart(uint8_t rawAddr) const;
 	result_t llRepeatedStart(uint8_t rawAddr) const;
 	result_t llStartWait(uint8_t rawAddr) const;
+	// Acknowledge polling, eg for the end of an EEPROM write cycle. The
+	// start and address are sent repeatedly, with a stop and a wait of
+	// interval_us after each NACK, until the device acknowledges. On ack
+	// the bus is left as for llStart(). Returns nack if deadline_us
+	// expires first, or timedOut if SCL was held low. Attempts which are
+	// not acknowledged are not added to the PEC.
+	result_t llStartPoll(uint8_t rawAddr, uint32_t interval_us, uint32_t deadline_us) const;
 
 	result_t stop(void) const;
 
+	// Release a bus left in an unknown state, for instance by a reset
+	// during a read. If a slave holds SDA low SCL is clocked up to 9
+	// times until SDA is released, then a stop is sent. Called by begin()
+	// and after a timeout. Whilst the bus is stuck each start tries to
+	// recover it and fails immediately if it cannot.
+	busStatus_t recoverBus(void) const;
+	inline busStatus_t getBusStatus(void) const {
+		return _busStatus;
+	}
+
 	inline result_t startRead(uint8_t addr) const;
 	inline result_t startWrite(uint8_t addr) const;
 	inline result_t repeatedStartRead(uint8_t addr) const;
@@ -74,16 +285,60 @@ public:
 	inline result_t start(uint8_t addr, mode_t rwMode) const;
 	inline result_t repeatedStart(uint8_t addr, mode_t rwMode) const;
 	inline result_t startWait(uint8_t addr, mode_t rwMode) const;
+	inline result_t startPoll(uint8_t addr, mode_t rwMode,
+							  uint32_t interval_us, uint32_t deadline_us) const;
 
 	result_t llWrite(uint8_t data) const;
 	result_t llRead(uint8_t &data, bool sendAck = true) const;
+
+	// Transfer a whole buffer under a single timeout. The transfer stops
+	// at the first byte which is not acknowledged. When reading every
+	// byte is acknowledged except the last, unless nackLast is false.
+	// If count is not NULL it is set to the number of bytes read
+	// successfully, including when an error ends the read early.
+	result_t llWriteBuffer(const uint8_t *data, size_t len) const;
+	result_t llReadBuffer(uint8_t *data, size_t len, bool nackLast = true,
+						  size_t *count = NULL) const;
+
+	// Write the register address (or command) reg and then, after a
+	// repeated start, read n bytes into out. A stop is always sent. The
+	// whole transaction shares a single timeout and the first error is
+	// returned.
+	result_t readRegister(uint8_t addr, const uint8_t *reg, size_t regLen,
+						  uint8_t *out, size_t n) const;
+	// Write the register address (or command) reg followed by n bytes
+	// from data, in a single transaction.
+	result_t writeRegister(uint8_t addr, const uint8_t *reg, size_t regLen,
+						   const uint8_t *data, size_t n) const;
+
+	// Transfer the segments to or from one device in a single
+	// transaction. Consecutive segments in the same direction are
+	// clocked back-to-back and a repeated start is sent when the
+	// direction changes. The last byte read before a repeated start or
+	// the stop is not acknowledged. A stop is always sent, and the first
+	// error is returned.
+	result_t transfer(uint8_t addr, const segment_t *segs, uint8_t n) const;
+
+	// Probe the addresses first to last inclusive with a quick write: the
+	// address is sent in write mode and the stop follows the ACK bit. Bit
+	// (addr & 7) of bitmap[addr >> 3] is set for each address which
+	// acknowledged; bitmap must have 16 bytes. gap_us is an extra delay
+	// between probes. The whole scan shares one timeout. Returns ack, or
+	// timedOut if the scan was abandoned because SCL was held low.
+	result_t scan(uint8_t *bitmap, uint8_t first = 0x01, uint8_t last = 0x7F,
+				  uint16_t gap_us = 0) const;
+
 	inline result_t readThenAck(uint8_t &data) const;
 	inline result_t readThenNack(uint8_t &data) const;
 
+	// Always drive the line, even if the master's output is believed to
+	// be at that level already
 	inline void sdaLow(void) const;
 	inline void sdaHigh(void) const;
 	inline void sclLow(void) const;
 	inline void sclHigh(void) const;
+	inline uint8_t readSda(void) const;
+	inline uint8_t readScl(void) const;
 	inline bool sclHighAndStretch(AsyncDelay& timeout) const;
 
 
@@ -109,6 +364,31 @@ public:
         _readScl = readScl;
     }
 
+    // User-defined pointer, for line drivers which require additional
+    // state
+    inline void setContext(void *context) {
+        _context = context;
+    }
+    inline void* getContext(void) const {
+        return _context;
+    }
+
+#ifdef SOFTWIRE_HAS_PORT_REGISTERS
+    // Use direct port access instead of pinMode(), digitalWrite() and
+    // digitalRead(). The registers and bitmasks are resolved from the pin
+    // numbers by begin(), which also sets the pins to the input mode
+    // with pinMode(). If the pins are invalid the default functions are
+    // restored.
+    void useDirectPortAccess(void);
+#endif
+
+    // Use direct port access with explicitly-configured registers. This
+    // does not require support from the core, and the registers may be
+    // ordinary variables when testing without hardware. Both SDA and SCL
+    // must be configured before calling begin().
+    void setSdaPort(portReg_t *mode, portReg_t *output, portReg_t *input, portValue_t mask);
+    void setSclPort(portReg_t *mode, portReg_t *output, portReg_t *input, portValue_t mask);
+
     // Wrapper functions to provide direct compatibility with the Wire library (TwoWire class)
     virtual int available(void);
     virtual size_t write(uint8_t data);
@@ -119,11 +399,19 @@ public:
         // TODO: (to be implemented in Wire)
     }
 
-	void setClock(uint32_t frequency); // Approximate frequency in Hz
+	// Approximate frequency in Hz. The timing of the Standard, Fast or
+	// Fast-mode Plus preset is used, as appropriate for the frequency,
+	// with tLOW and tHIGH scaled to give the requested clock period.
+	void setClock(uint32_t frequency);
     void beginTransmission(uint8_t address);
     inline void beginTransmission(int address) {
         beginTransmission((uint8_t)address);
     }
+    // Zero-copy transmission: endTransmission() sends the spans in order
+    // directly from the caller's memory, no TX buffer is used. The spans
+    // and their data must remain valid until endTransmission() returns.
+    // write() cannot be used with this form.
+    void beginTransmission(uint8_t address, const span_t *spans, uint8_t numSpans);
 
     uint8_t endTransmission(uint8_t);
     uint8_t endTransmission(void) {
@@ -131,44 +419,100 @@ public:
     }
 
 
+    // Up to the size of the RX buffer may be read, which can be more
+    // than 255 bytes
     uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop = true);
-    inline uint8_t requestFrom(int address, int quantity, int sendStop = true) {
-        return requestFrom((uint8_t)address, (uint8_t)quantity, (uint8_t)sendStop);
+    inline size_t requestFrom(int address, int quantity, int sendStop = true) {
+        return requestFrom((uint8_t)address, size_t(quantity), bool(sendStop));
     }
+    size_t requestFrom(uint8_t address, size_t quantity, bool sendStop = true);
 
     // The Wire compatibility functions require RX and TX buffers. The same address space may be used for both
     // as long as the user does not call receiveFrom between startTransmission and endTransmission.
-    inline void setRxBuffer(void *rxBuffer, uint8_t rxBufferSize) {
+    inline void setRxBuffer(void *rxBuffer, size_t rxBufferSize) {
         _rxBuffer = (uint8_t*)rxBuffer;
         _rxBufferSize = rxBufferSize;
         _rxBufferIndex = 0;
         _rxBufferBytesRead = 0;
     }
 
-    inline void setTxBuffer(void *txBuffer, uint8_t txBufferSize) {
+    inline void setTxBuffer(void *txBuffer, size_t txBufferSize) {
         _txBuffer = (uint8_t*)txBuffer;
         _txBufferSize = txBufferSize;
         _txBufferIndex = 0;
     }
 
+    // Transaction queue. The user must supply storage for the queue
+    // descriptors. Transactions are enqueued and then run back-to-back by
+    // execute(). Consecutive transactions to the same address are joined
+    // with a repeated start, a stop is sent when the address changes, at
+    // the end of the queue and after an error. The result of each
+    // transaction is stored in its descriptor, execute() returns the
+    // first error. The queue is emptied by execute().
+    inline void setQueue(transaction_t *queue, uint8_t queueSize) {
+        _queue = queue;
+        _queueSize = queueSize;
+        _queueLength = 0;
+    }
+
+    inline uint8_t getQueueLength(void) const {
+        return _queueLength;
+    }
+
+    inline void clearQueue(void) {
+        _queueLength = 0;
+    }
+
+    // Return false if the queue is full
+    bool enqueueRead(uint8_t addr, uint8_t *data, size_t len);
+    bool enqueueWrite(uint8_t addr, const uint8_t *data, size_t len);
+    result_t execute(void);
+
 private:
 	uint8_t _sda;
 	uint8_t _scl;
 	uint8_t _inputMode;
-	uint8_t _delay_us;
-	uint16_t _timeout_ms;
+	timing_t _timing;
+	timingCycles_t _cycles;
+
+	// Bits of _lines. A line's level is only relied upon once it has been
+	// driven by SoftWire after begin().
+	enum lines_t {
+		sdaKnown = 0x01,
+		sdaLowBit = 0x02,
+		sclKnown = 0x04,
+		sclLowBit = 0x08,
+		stopSent = 0x10, // Set by stopInner(), cleared by any change
+		busIdle = sdaKnown | sclKnown | stopSent,
+	};
+	uint32_t _timeout_us;
+	uint32_t _transactionTimeout_us;
+	mutable AsyncDelay _transactionTimeout;
+	mutable bool _transactionActive; // Transaction deadline applies
+	mutable phase_t _phase;
+	mutable phase_t _timeoutPhase;
+	mutable busStatus_t _busStatus;
+	uint32_t _frequency; // Set by setClock(), 0 if the delay was set directly
+	uint16_t _overhead_ns; // Line driver time per half-bit
+	bool _pecEnabled;
+	mutable uint8_t _pec;
+	mutable uint8_t _lines; // Known state of the master's outputs, see lines_t
+	// Always present so that the layout does not depend on SOFTWIRE_STATS
+	mutable uint32_t _timeoutChecks;
 
 	// Additional member variables to support compatibility with Wire library
 	uint8_t *_rxBuffer;
-	uint8_t _rxBufferSize;
-	uint8_t _rxBufferIndex;
-	uint8_t _rxBufferBytesRead;
+	size_t _rxBufferSize;
+	size_t _rxBufferIndex;
+	size_t _rxBufferBytesRead;
 
 	uint8_t _txAddress; // The address where data is to be sent to
 	uint8_t *_txBuffer; // Address of user-supplied buffer
-	uint8_t _txBufferSize; // Size of user-supplied buffer
+	size_t _txBufferSize; // Size of user-supplied buffer
 	//uint8_t _txBufferLength; // Length of data the user tried to send
-	uint8_t _txBufferIndex; // Index into buffer
+	size_t _txBufferIndex; // Index into buffer
+	const span_t *_txSpans; // Caller-owned spans, NULL when the TX buffer is used
+	uint8_t _txNumSpans;
 
 	void (*_sdaLow)(const SoftWire *p);
 	void (*_sdaHigh)(const SoftWire *p);
@@ -176,12 +520,61 @@ private:
 	void (*_sclHigh)(const SoftWire *p);
 	uint8_t (*_readSda)(const SoftWire *p);
 	uint8_t (*_readScl)(const SoftWire *p);
-
+	void *_context;
+
+	transaction_t *_queue; // Address of user-supplied queue
+	uint8_t _queueSize;
+	uint8_t _queueLength;
+
+	port_t _sdaPort;
+	port_t _sclPort;
+	bool _resolvePorts; // Set if begin() must look up _sdaPort and _sclPort
+
+	inline bool isExpired(AsyncDelay &timeout) const;
+	inline bool deadlineExpired(void) const;
+	// Wait whilst a slave holds SCL low, false on timeout
+	inline bool waitForScl(AsyncDelay &timeout) const;
+	void beginTransaction(void) const;
+	// Change the master's output unless it is known to be at that level
+	inline void driveSda(uint8_t level) const;
+	inline void driveScl(uint8_t level) const;
+	// Data and ACK bits for SoftWireSequencer
+	inline void writeBit(uint8_t data, uint8_t bit) const;
+	inline void readBit(uint8_t &data) const;
+	inline void readAck(result_t &res) const;
+	void useDirectDrivers(void);
+	transaction_t* enqueue(uint8_t addr, mode_t mode, size_t len);
+	result_t llStartInner(uint8_t rawAddr, AsyncDelay &timeout) const;
+	result_t llRepeatedStartInner(uint8_t rawAddr, AsyncDelay &timeout) const;
+	result_t stopInner(AsyncDelay &timeout) const;
+	result_t llWriteByte(uint8_t data, AsyncDelay &timeout) const;
+	result_t llReadByte(uint8_t &data, bool sendAck, AsyncDelay &timeout) const;
+	result_t llWriteBufferInner(const uint8_t *data, size_t len, AsyncDelay &timeout) const;
+	result_t llReadBufferInner(uint8_t *data, size_t len, bool nackLast, AsyncDelay &timeout,
+							   size_t *count = NULL) const;
+#ifdef SOFTWIRE_HAS_PORT_REGISTERS
+	static bool resolvePort(uint8_t pin, port_t &port);
+#endif
 
 	uint8_t endTransmissionInner(void) const;
+
+	template <class Lines> friend class SoftWireSequencer;
 };
 
 
+SoftWire::segment_t SoftWire::segment_t::write(const uint8_t *data, size_t len)
+{
+	segment_t seg = {writeMode, data, NULL, len};
+	return seg;
+}
+
+SoftWire::segment_t SoftWire::segment_t::read(uint8_t *data, size_t len)
+{
+	segment_t seg = {readMode, NULL, data, len};
+	return seg;
+}
+
+
 uint8_t SoftWire::getSda(void) const
 {
 	return _sda;
@@ -196,12 +589,43 @@ uint8_t SoftWire::getScl(void) const
 
 uint8_t SoftWire::getDelay_us(void) const
 {
-	return _delay_us;
+	uint32_t delay_us = (getDelay_ns() + 500) / 1000;
+	return (delay_us > 255 ? 255 : delay_us);
+}
+
+uint32_t SoftWire::getDelay_ns(void) const
+{
+	return (_timing.low_ns + _timing.high_ns) / 2;
+}
+
+const SoftWire::timing_t& SoftWire::getTiming(void) const
+{
+	return _timing;
 }
 
 uint16_t SoftWire::getTimeout_ms(void) const
 {
-	return _timeout_ms;
+	return _timeout_us / 1000;
+}
+
+uint32_t SoftWire::getTimeout_us(void) const
+{
+	return _timeout_us;
+}
+
+uint32_t SoftWire::getTransactionTimeout_us(void) const
+{
+	return _transactionTimeout_us;
+}
+
+SoftWire::phase_t SoftWire::getTimeoutPhase(void) const
+{
+	return _timeoutPhase;
+}
+
+uint16_t SoftWire::getOverhead_ns(void) const
+{
+	return _overhead_ns;
 }
 
 uint8_t SoftWire::getInputMode(void) const
@@ -229,13 +653,50 @@ void SoftWire::enablePullups(bool enable)
 
 void SoftWire::setDelay_us(uint8_t delay_us)
 {
-	_delay_us = delay_us;
+	setDelay_ns(delay_us * uint32_t(1000));
 }
 
 
 void SoftWire::setTimeout_ms(uint16_t timeout_ms)
 {
-	_timeout_ms = timeout_ms;
+	_timeout_us = timeout_ms * uint32_t(1000);
+}
+
+
+void SoftWire::setTimeout_us(uint32_t timeout_us)
+{
+	_timeout_us = timeout_us;
+}
+
+
+void SoftWire::setTransactionTimeout_us(uint32_t timeout_us)
+{
+	_transactionTimeout_us = timeout_us;
+}
+
+
+void SoftWire::enablePec(bool enable)
+{
+	_pecEnabled = enable;
+	_pec = 0;
+}
+
+
+bool SoftWire::isPecEnabled(void) const
+{
+	return _pecEnabled;
+}
+
+
+void SoftWire::resetPec(void)
+{
+	_pec = 0;
+}
+
+
+uint8_t SoftWire::getPec(void) const
+{
+	return _pec;
 }
 
 
@@ -293,6 +754,13 @@ SoftWire::result_t SoftWire::startWait(uint8_t addr, mode_t rwMode) const
 }
 
 
+SoftWire::result_t SoftWire::startPoll(uint8_t addr, mode_t rwMode,
+									   uint32_t interval_us, uint32_t deadline_us) const
+{
+	return llStartPoll((addr << 1) + rwMode, interval_us, deadline_us);
+}
+
+
 SoftWire::result_t SoftWire::readThenAck(uint8_t &data) const
 {
 	return llRead(data, true);
@@ -308,37 +776,137 @@ SoftWire::result_t SoftWire::readThenNack(uint8_t &data) const
 void SoftWire::sdaLow(void) const
 {
 	_sdaLow(this);
+	_lines = (_lines & ~(sdaKnown | sdaLowBit | stopSent)) | sdaKnown | sdaLowBit;
 }
 
 
 void SoftWire::sdaHigh(void) const
 {
 	_sdaHigh(this);
+	_lines = (_lines & ~(sdaKnown | sdaLowBit | stopSent)) | sdaKnown;
 }
 
 
 void SoftWire::sclLow(void) const
 {
 	_sclLow(this);
+	_lines = (_lines & ~(sclKnown | sclLowBit | stopSent)) | sclKnown | sclLowBit;
 }
 
 
 void SoftWire::sclHigh(void) const
 {
 	_sclHigh(this);
+	_lines = (_lines & ~(sclKnown | sclLowBit | stopSent)) | sclKnown;
+}
+
+
+uint8_t SoftWire::readSda(void) const
+{
+	return _readSda(this);
+}
+
+
+uint8_t SoftWire::readScl(void) const
+{
+	return _readScl(this);
 }
 
+
+bool SoftWire::isExpired(AsyncDelay &timeout) const
+{
+#if SOFTWIRE_STATS
+	++_timeoutChecks;
+#endif
+	if (timeout.isExpired()
+		|| (_transactionActive && _transactionTimeout.isExpired())) {
+		// Report the first phase to time out, not the stop which follows
+		if (_timeoutPhase == noPhase)
+			_timeoutPhase = _phase;
+		return true;
+	}
+	return false;
+}
+
+
+bool SoftWire::deadlineExpired(void) const
+{
+	return _transactionActive && isExpired(_transactionTimeout);
+}
+
+
+void SoftWire::driveSda(uint8_t level) const
+{
+	uint8_t state = (level ? sdaKnown : sdaKnown | sdaLowBit);
+	if ((_lines & (sdaKnown | sdaLowBit)) == state)
+		return;
+	if (level)
+		_sdaHigh(this);
+	else
+		_sdaLow(this);
+	_lines = (_lines & ~(sdaLowBit | stopSent)) | state;
+}
+
+
+void SoftWire::driveScl(uint8_t level) const
+{
+	uint8_t state = (level ? sclKnown : sclKnown | sclLowBit);
+	if ((_lines & (sclKnown | sclLowBit)) == state)
+		return;
+	if (level)
+		_sclHigh(this);
+	else
+		_sclLow(this);
+	_lines = (_lines & ~(sclLowBit | stopSent)) | state;
+}
+
+
+void SoftWire::writeBit(uint8_t data, uint8_t bit) const
+{
+	driveSda(data & bit ? HIGH : LOW);
+}
+
+
+void SoftWire::readBit(uint8_t &data) const
+{
+	data <<= 1;
+	if (_readSda(this))
+		data |= 1;
+}
+
+
+void SoftWire::readAck(result_t &res) const
+{
+	res = (_readSda(this) == LOW ? ack : nack);
+}
+
+
+bool SoftWire::waitForScl(AsyncDelay& timeout) const
+{
+	// The timeout is only checked whilst SCL is stretched, so no time is
+	// spent reading the clock otherwise. It is restarted for each
+	// stretch, so that it limits the length of a stretch and not of the
+	// whole transfer.
+	if (_readScl(this) == LOW) {
+		timeout.restart();
+		while (_readScl(this) == LOW)
+			if (isExpired(timeout))
+				return false;
+	}
+	return true;
+}
+
+
 bool SoftWire::sclHighAndStretch(AsyncDelay& timeout) const
 {
-	_sclHigh(this);
+	driveScl(HIGH);
 
 	// Wait for SCL to actually become high in case the slave keeps
-	// it low (clock stretching).
-	while (_readScl(this) == LOW)
-		if (timeout.isExpired()) {
-			stop(); // Reset bus
-			return false;
-		}
+	// it low (clock stretching)
+	if (!waitForScl(timeout)) {
+		recoverBus(); // Reset bus
+		return false;
+	}
 
 	return true;
 }
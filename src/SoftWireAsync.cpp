@@ -0,0 +1,243 @@
+#include <SoftWireAsync.h>
+
+
+SoftWireAsync::SoftWireAsync(SoftWire &sw) :
+	_sw(sw),
+	_state(idle),
+	_result(SoftWire::ack),
+	_callback(NULL),
+	_timer(NULL),
+	_lastTick_us(0),
+	_addr(0),
+	_txData(NULL),
+	_txLen(0),
+	_txIndex(0),
+	_rxData(NULL),
+	_rxLen(0),
+	_rxIndex(0),
+	_reading(false),
+	_byte(0),
+	_bit(0)
+{
+	;
+}
+
+
+bool SoftWireAsync::submit(uint8_t addr, const uint8_t *txData, size_t txLen,
+						   uint8_t *rxData, size_t rxLen)
+{
+	if (busy())
+		return false;
+
+	_addr = addr;
+	_txData = txData;
+	_txLen = txLen;
+	_txIndex = 0;
+	_rxData = rxData;
+	_rxLen = rxLen;
+	_rxIndex = 0;
+
+	// Skip the write phase when there is nothing to write
+	_reading = (txLen == 0 && rxLen != 0);
+	_byte = (addr << 1) + (_reading ? SoftWire::readMode : SoftWire::writeMode);
+	_result = SoftWire::ack;
+	_timeout.start(_sw.getTimeout_us(), AsyncDelay::MICROS);
+	_state = startSda;
+
+	if (_timer) {
+		uint8_t delay_us = _sw.getDelay_us();
+		_timer->start(delay_us ? delay_us : 1, timerHandler, this);
+	}
+	return true;
+}
+
+
+void SoftWireAsync::poll(void)
+{
+	if (_state != idle && micros() - _lastTick_us >= _sw.getDelay_us())
+		tick();
+}
+
+
+void SoftWireAsync::tick(void)
+{
+	switch (_state) {
+	case idle:
+		return;
+
+	case startSda:
+		// SCL is high, force SDA low
+		_sw.sdaLow();
+		startWriteByte(_byte);
+		break;
+
+	case writeBitLow:
+		_sw.sclLow();
+		if (_byte & 0x80)
+			_sw.sdaHigh();
+		else
+			_sw.sdaLow();
+		_state = writeBitHigh;
+		break;
+
+	case writeBitHigh:
+		if (!releaseScl())
+			return;
+		_byte <<= 1;
+		_state = (--_bit ? writeBitLow : writeAckLow);
+		break;
+
+	case writeAckLow:
+		_sw.sclLow();
+		_sw.sdaHigh();
+		_state = writeAckHigh;
+		break;
+
+	case writeAckHigh:
+		if (!releaseScl())
+			return;
+		if (_sw.readSda() == LOW)
+			nextByte();
+		else
+			startStop(SoftWire::nack);
+		break;
+
+	case readBitLow:
+		_sw.sclLow();
+		_sw.sdaHigh();
+		_state = readBitHigh;
+		break;
+
+	case readBitHigh:
+		if (!releaseScl())
+			return;
+		_byte <<= 1;
+		if (_sw.readSda())
+			_byte |= 1;
+		_state = (--_bit ? readBitLow : readAckLow);
+		break;
+
+	case readAckLow:
+		_sw.sclLow();
+		_rxData[_rxIndex++] = _byte;
+		if (_rxIndex < _rxLen)
+			_sw.sdaLow(); // ACK
+		else
+			_sw.sdaHigh(); // NACK the last byte
+		_state = readAckHigh;
+		break;
+
+	case readAckHigh:
+		if (!releaseScl())
+			return;
+		nextByte();
+		break;
+
+	case repeatedStartLow:
+		_sw.sclLow();
+		_sw.sdaHigh();
+		_state = repeatedStartHigh;
+		break;
+
+	case repeatedStartHigh:
+		if (!releaseScl())
+			return;
+		_state = startSda;
+		break;
+
+	case stopLow:
+		_sw.sclLow();
+		_sw.sdaLow();
+		_timeout.restart();
+		_state = stopHigh;
+		break;
+
+	case stopHigh:
+		_sw.sclHigh();
+		if (_sw.readScl() == LOW) {
+			if (!_timeout.isExpired())
+				return; // Clock stretching
+			_result = SoftWire::timedOut;
+		}
+		_state = stopSda;
+		break;
+
+	case stopSda:
+		_sw.sdaHigh();
+		if (_timer)
+			_timer->stop();
+		_state = idle;
+		_lastTick_us = micros();
+		if (_callback)
+			(*_callback)(this, _result);
+		return;
+	}
+
+	_lastTick_us = micros();
+}
+
+
+void SoftWireAsync::timerHandler(void *context)
+{
+	((SoftWireAsync*)context)->tick();
+}
+
+
+// Release SCL, returns false whilst the slave is stretching the clock. On
+// timeout the transaction is aborted with a stop.
+bool SoftWireAsync::releaseScl(void)
+{
+	_sw.sclHigh();
+	if (_sw.readScl() == HIGH)
+		return true;
+
+	if (_timeout.isExpired())
+		startStop(SoftWire::timedOut);
+	return false;
+}
+
+
+void SoftWireAsync::startWriteByte(uint8_t data)
+{
+	_byte = data;
+	_bit = 8;
+	_timeout.restart();
+	_state = writeBitLow;
+}
+
+
+void SoftWireAsync::startReadByte(void)
+{
+	_byte = 0;
+	_bit = 8;
+	_timeout.restart();
+	_state = readBitLow;
+}
+
+
+void SoftWireAsync::startStop(SoftWire::result_t result)
+{
+	_result = result;
+	_state = stopLow;
+}
+
+
+// Choose what follows a completed byte
+void SoftWireAsync::nextByte(void)
+{
+	if (_reading) {
+		if (_rxIndex < _rxLen)
+			startReadByte();
+		else
+			startStop(SoftWire::ack);
+	}
+	else if (_txIndex < _txLen)
+		startWriteByte(_txData[_txIndex++]);
+	else if (_rxLen) {
+		_reading = true;
+		_byte = (_addr << 1) + SoftWire::readMode;
+		_state = repeatedStartLow;
+	}
+	else
+		startStop(SoftWire::ack);
+}
@@ -0,0 +1,101 @@
+#ifndef SOFTWIREASYNC_H
+#define SOFTWIREASYNC_H
+
+#include <SoftWire.h>
+#include <SoftWireTimer.h>
+
+// Non-blocking transfers on a SoftWire bus. A transaction is submitted
+// and then advanced by one half-bit per call to tick(), or per call to
+// poll() once the SoftWire delay has elapsed. Alternatively a timer can
+// be set, in which case the timer is started by submit() with the
+// SoftWire delay as its period, calls tick() from its interrupt, and is
+// stopped when the transaction completes. The line drivers, delay and
+// timeout configured for the SoftWire object are used.
+//
+// A transaction writes txLen bytes and then, after a repeated start,
+// reads rxLen bytes. Either length may be zero. A stop is always sent.
+class SoftWireAsync {
+public:
+	typedef void (*callback_t)(SoftWireAsync *p, SoftWire::result_t result);
+
+	SoftWireAsync(SoftWire &sw);
+
+	inline SoftWire& getSoftWire(void) const {
+		return _sw;
+	}
+
+	// Returns false if a transaction is already in progress. The buffers
+	// must remain valid until the transaction has completed.
+	bool submit(uint8_t addr, const uint8_t *txData, size_t txLen,
+				uint8_t *rxData = NULL, size_t rxLen = 0);
+
+	inline bool busy(void) const {
+		return _state != idle;
+	}
+
+	// Result of the last completed transaction
+	inline SoftWire::result_t getResult(void) const {
+		return _result;
+	}
+
+	// Function called when a transaction completes. It is called from
+	// poll() or tick() and so may be in interrupt context.
+	inline void setCallback(callback_t callback) {
+		_callback = callback;
+	}
+
+	// Clock transfers from a timer. Set to NULL to use poll() or tick().
+	inline void setTimer(SoftWireTimer *timer) {
+		_timer = timer;
+	}
+
+	void poll(void); // Advance if the half-bit delay has elapsed
+	void tick(void); // Advance by one half-bit now
+
+private:
+	enum state_t {
+		idle = 0,
+		startSda,
+		writeBitLow,
+		writeBitHigh,
+		writeAckLow,
+		writeAckHigh,
+		readBitLow,
+		readBitHigh,
+		readAckLow,
+		readAckHigh,
+		repeatedStartLow,
+		repeatedStartHigh,
+		stopLow,
+		stopHigh,
+		stopSda,
+	};
+
+	SoftWire &_sw;
+	volatile state_t _state;
+	SoftWire::result_t _result;
+	callback_t _callback;
+	SoftWireTimer *_timer;
+	AsyncDelay _timeout;
+	unsigned long _lastTick_us;
+
+	uint8_t _addr;
+	const uint8_t *_txData;
+	size_t _txLen;
+	size_t _txIndex;
+	uint8_t *_rxData;
+	size_t _rxLen;
+	size_t _rxIndex;
+	bool _reading;
+	uint8_t _byte;
+	uint8_t _bit;
+
+	static void timerHandler(void *context);
+	bool releaseScl(void);
+	void startWriteByte(uint8_t data);
+	void startReadByte(void);
+	void startStop(SoftWire::result_t result);
+	void nextByte(void);
+};
+
+#endif
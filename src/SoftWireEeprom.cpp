@@ -0,0 +1,105 @@
+#include <SoftWireEeprom.h>
+
+
+SoftWireEeprom::SoftWireEeprom(SoftWire &sw, uint8_t address, uint32_t size,
+							   uint16_t pageSize, uint8_t addressBytes) :
+	_sw(sw),
+	_address(address),
+	_size(size),
+	_pageSize(pageSize),
+	_addressBytes(addressBytes),
+	_pollInterval_us(defaultPollInterval_us),
+	_writeTimeout_us(defaultWriteTimeout_us),
+	_writing(false)
+{
+	;
+}
+
+
+SoftWireEeprom::result_t SoftWireEeprom::read(uint32_t memAddr, uint8_t *data, size_t len)
+{
+	if (memAddr + len > _size)
+		return SoftWire::nack;
+	if (len == 0)
+		return SoftWire::ack;
+
+	result_t r = start(memAddr);
+	if (r == SoftWire::ack)
+		r = _sw.llRepeatedStart(rawAddress(memAddr, SoftWire::readMode));
+	if (r == SoftWire::ack)
+		r = _sw.llReadBuffer(data, len);
+
+	result_t s = _sw.stop();
+	return (r == SoftWire::ack ? s : r);
+}
+
+
+SoftWireEeprom::result_t SoftWireEeprom::write(uint32_t memAddr, const uint8_t *data, size_t len)
+{
+	if (memAddr + len > _size)
+		return SoftWire::nack;
+
+	while (len) {
+		// Up to the end of the page
+		size_t n = _pageSize - (memAddr % _pageSize);
+		if (n > len)
+			n = len;
+
+		result_t r = writePage(memAddr, data, n);
+		if (r != SoftWire::ack)
+			return r;
+		memAddr += n;
+		data += n;
+		len -= n;
+	}
+	return SoftWire::ack;
+}
+
+
+SoftWireEeprom::result_t SoftWireEeprom::waitForWrite(void)
+{
+	if (!_writing)
+		return SoftWire::ack;
+
+	result_t r = _sw.startPoll(_address, SoftWire::writeMode, _pollInterval_us, _writeTimeout_us);
+	_sw.stop();
+	if (r == SoftWire::ack)
+		_writing = false;
+	return r;
+}
+
+
+// Address the device and send the memory address. If a write cycle may
+// be in progress the start doubles as the acknowledge poll.
+SoftWireEeprom::result_t SoftWireEeprom::start(uint32_t memAddr)
+{
+	uint8_t rawAddr = rawAddress(memAddr, SoftWire::writeMode);
+	result_t r;
+	if (_writing)
+		r = _sw.llStartPoll(rawAddr, _pollInterval_us, _writeTimeout_us);
+	else
+		r = _sw.llStart(rawAddr);
+	if (r != SoftWire::ack)
+		return r;
+	_writing = false;
+
+	// Most significant byte first
+	for (uint8_t i = _addressBytes; i && r == SoftWire::ack; --i)
+		r = _sw.llWrite(uint8_t(memAddr >> (8 * (i - 1))));
+	return r;
+}
+
+
+SoftWireEeprom::result_t SoftWireEeprom::writePage(uint32_t memAddr, const uint8_t *data, size_t len)
+{
+	result_t r = start(memAddr);
+	if (r == SoftWire::ack) {
+		// The write cycle starts at the stop, even if some of the data is
+		// not acknowledged
+		_writing = true;
+		r = _sw.llWriteBuffer(data, len);
+	}
+
+	result_t s = _sw.stop();
+	return (r == SoftWire::ack ? s : r);
+}
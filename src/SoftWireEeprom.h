@@ -0,0 +1,82 @@
+#ifndef SOFTWIREEEPROM_H
+#define SOFTWIREEEPROM_H
+
+#include <SoftWire.h>
+
+// Driver for 24Cxx-type EEPROMs. Writes of any length are split at page
+// boundaries. The write cycle of each page is not waited for; instead
+// the start of the next transaction to the device polls for its
+// acknowledge, so that the next page is sent as soon as the device is
+// ready. Reads of any length are made in one transaction.
+//
+// addressBytes is the width of the memory address sent after the device
+// address. Memory beyond that range (eg 24C04 to 24C16, or 24CM01) is
+// selected by the low bits of the device address.
+class SoftWireEeprom {
+public:
+	typedef SoftWire::result_t result_t;
+
+	static const uint16_t defaultPollInterval_us = 100;
+	static const uint32_t defaultWriteTimeout_us = 10000;
+
+	SoftWireEeprom(SoftWire &sw, uint8_t address, uint32_t size,
+				   uint16_t pageSize, uint8_t addressBytes);
+
+	inline SoftWire& getSoftWire(void) const {
+		return _sw;
+	}
+	inline uint8_t getAddress(void) const {
+		return _address;
+	}
+	inline uint32_t getSize(void) const {
+		return _size;
+	}
+	inline uint16_t getPageSize(void) const {
+		return _pageSize;
+	}
+	inline uint8_t getAddressBytes(void) const {
+		return _addressBytes;
+	}
+
+	// Interval between acknowledge polls, and the longest time to wait
+	// for a write cycle to complete
+	inline void setPollInterval_us(uint16_t interval_us) {
+		_pollInterval_us = interval_us;
+	}
+	inline void setWriteTimeout_us(uint32_t timeout_us) {
+		_writeTimeout_us = timeout_us;
+	}
+
+	// True if a write cycle may still be in progress
+	inline bool isWriting(void) const {
+		return _writing;
+	}
+
+	// The functions return nack, without accessing the bus, if the range
+	// extends beyond the end of the memory. nack is also returned if the
+	// device does not complete a write cycle within the write timeout.
+	result_t read(uint32_t memAddr, uint8_t *data, size_t len);
+	result_t write(uint32_t memAddr, const uint8_t *data, size_t len);
+
+	// Wait for the last write cycle to complete
+	result_t waitForWrite(void);
+
+private:
+	SoftWire &_sw;
+	uint8_t _address;
+	uint32_t _size;
+	uint16_t _pageSize;
+	uint8_t _addressBytes;
+	uint16_t _pollInterval_us;
+	uint32_t _writeTimeout_us;
+	bool _writing;
+
+	// Device address, including any memory address bits
+	inline uint8_t rawAddress(uint32_t memAddr, SoftWire::mode_t mode) const {
+		return (uint8_t(_address | (memAddr >> (8 * _addressBytes))) << 1) + mode;
+	}
+	result_t start(uint32_t memAddr);
+	result_t writePage(uint32_t memAddr, const uint8_t *data, size_t len);
+};
+
+#endif
@@ -0,0 +1,306 @@
+#if defined(ARDUINO_ARCH_AVR)
+#include <util/atomic.h>
+#endif
+
+#include <SoftWireMulti.h>
+#include <SoftWireSequencer.h>
+
+
+SoftWireMulti::SoftWireMulti(void) :
+	_numBuses(0),
+	_pullups(false), // Pullups disabled by default
+	_timeout_us(SoftWire::defaultTimeout_ms * uint32_t(1000))
+{
+	_sdaPort.mode = _sdaPort.output = _sdaPort.input = NULL;
+	_sdaPort.mask = 0;
+	_sclPort = _sdaPort;
+	setDelay_ns(SoftWire::defaultDelay_us * uint32_t(1000));
+}
+
+
+void SoftWireMulti::setDelay_ns(uint32_t delay_ns)
+{
+	SoftWire::timing_t timing;
+	timing.low_ns = timing.high_ns = timing.suDat_ns = delay_ns;
+	timing.hdSta_ns = timing.suSta_ns = timing.suSto_ns = timing.buf_ns = delay_ns;
+	setTiming(timing);
+}
+
+
+void SoftWireMulti::setTiming(const SoftWire::timing_t &timing)
+{
+	_timing = timing;
+	SoftWire::timingToCycles(timing, _cycles);
+}
+
+
+void SoftWireMulti::setSdaPort(portReg_t *mode, portReg_t *output, portReg_t *input)
+{
+	_sdaPort.mode = mode;
+	_sdaPort.output = output;
+	_sdaPort.input = input;
+}
+
+
+void SoftWireMulti::setSclPort(portReg_t *mode, portReg_t *output, portReg_t *input)
+{
+	_sclPort.mode = mode;
+	_sclPort.output = output;
+	_sclPort.input = input;
+}
+
+
+int8_t SoftWireMulti::addBus(portValue_t sdaMask, portValue_t sclMask)
+{
+	if (_numBuses >= maxBuses)
+		return -1;
+
+	_sdaMask[_numBuses] = sdaMask;
+	_sdaPort.mask |= sdaMask;
+	_sclPort.mask |= sclMask;
+	return _numBuses++;
+}
+
+
+void SoftWireMulti::begin(void) const
+{
+	// Without pullups the output bits stay low, only the direction
+	// register is changed
+	if (!_pullups) {
+		*_sdaPort.output &= ~_sdaPort.mask;
+		*_sclPort.output &= ~_sclPort.mask;
+	}
+	recoverBus();
+}
+
+
+void SoftWireMulti::end(void) const
+{
+	driveSda(HIGH);
+	driveScl(HIGH);
+}
+
+
+// Force the lines in low to low and release all other lines of the port
+// (as given by port.mask). Without pullups this is a single write to the
+// direction register.
+void SoftWireMulti::drive(const SoftWire::port_t &port, portValue_t low) const
+{
+#ifdef ATOMIC_BLOCK
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+	{
+		if (_pullups) {
+			*port.output &= ~low;
+			*port.mode = (*port.mode & ~port.mask) | low;
+			*port.output |= (port.mask & ~low);
+		}
+		else
+			*port.mode = (*port.mode & ~port.mask) | low;
+	}
+}
+
+
+bool SoftWireMulti::waitForScl(AsyncDelay &timeout) const
+{
+	// Wait for all SCL lines to become high in case any slave keeps
+	// its line low (clock stretching). As for SoftWire the timeout is
+	// restarted for each stretch.
+	if ((*_sclPort.input & _sclPort.mask) != _sclPort.mask) {
+		timeout.restart();
+		while ((*_sclPort.input & _sclPort.mask) != _sclPort.mask)
+			if (timeout.isExpired())
+				return false;
+	}
+	return true;
+}
+
+
+bool SoftWireMulti::sclHighAndStretch(AsyncDelay &timeout) const
+{
+	driveScl(HIGH);
+	if (!waitForScl(timeout)) {
+		recoverBus(); // Reset bus
+		return false;
+	}
+	return true;
+}
+
+
+bool SoftWireMulti::sdaAllHigh(void) const
+{
+	return (*_sdaPort.input & _sdaPort.mask) == _sdaPort.mask;
+}
+
+
+SoftWire::busStatus_t SoftWireMulti::recoverBus(void) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	SoftWire::busStatus_t status = SoftWire::busOk;
+
+	driveSda(HIGH);
+	driveScl(HIGH);
+	SoftWire::delayCycles(_cycles.high);
+
+	if ((*_sclPort.input & _sclPort.mask) != _sclPort.mask)
+		return SoftWire::sclStuck;
+
+	// Clock out the rest of any byte being transmitted by a slave
+	for (uint8_t i = 9; i && !sdaAllHigh(); --i) {
+		status = SoftWire::busRecovered;
+		driveScl(LOW);
+		SoftWire::delayCycles(_cycles.hdDat + _cycles.suDat);
+		driveScl(HIGH);
+		if (!waitForScl(timeout))
+			return SoftWire::sclStuck;
+		SoftWire::delayCycles(_cycles.high);
+	}
+
+	if (!sdaAllHigh())
+		return SoftWire::sdaStuck;
+
+	if (stopInner(timeout) != SoftWire::ack)
+		return SoftWire::sclStuck;
+	return status;
+}
+
+
+void SoftWireMulti::writeBit(const uint8_t *data, uint8_t bit) const
+{
+	// SDA lines to force low for this bit
+	portValue_t low = 0;
+	for (uint8_t i = 0; i < _numBuses; ++i)
+		if ((data[i] & bit) == 0)
+			low |= _sdaMask[i];
+	drive(_sdaPort, low);
+}
+
+
+void SoftWireMulti::readBit(uint8_t *data) const
+{
+	portValue_t sda = *_sdaPort.input;
+	for (uint8_t i = 0; i < _numBuses; ++i) {
+		data[i] <<= 1;
+		if (sda & _sdaMask[i])
+			data[i] |= 1;
+	}
+}
+
+
+void SoftWireMulti::readAck(busMask_t &acked) const
+{
+	portValue_t sda = *_sdaPort.input;
+	acked = 0;
+	for (uint8_t i = 0; i < _numBuses; ++i)
+		if ((sda & _sdaMask[i]) == 0)
+			acked |= busMask_t(1) << i;
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::stop(void) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	return stopInner(timeout);
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::stopInner(AsyncDelay &timeout) const
+{
+	if (!SoftWireSequencer<SoftWireMulti>(*this, _cycles).stop(timeout))
+		return SoftWire::timedOut;
+	return SoftWire::ack;
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::llStart(uint8_t rawAddr, busMask_t &acked) const
+{
+	SoftWireSequencer<SoftWireMulti>(*this, _cycles).start();
+	return llWrite(rawAddr, acked);
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::llRepeatedStart(uint8_t rawAddr, busMask_t &acked) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	if (!SoftWireSequencer<SoftWireMulti>(*this, _cycles).repeatedStart(timeout)) {
+		acked = 0;
+		return SoftWire::timedOut;
+	}
+	return llWrite(rawAddr, acked);
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::llWrite(uint8_t data, busMask_t &acked) const
+{
+	uint8_t buffer[maxBuses];
+	memset(buffer, data, sizeof(buffer));
+	return llWrite(buffer, acked);
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::llWrite(const uint8_t *data, busMask_t &acked) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	return llWriteInner(data, acked, timeout);
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::llRead(uint8_t *data, bool sendAck) const
+{
+	AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+	return llReadInner(data, sendAck, timeout);
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::readRegister(uint8_t addr, const uint8_t *reg, size_t regLen,
+													uint8_t *out, size_t n, busMask_t &acked) const
+{
+	busMask_t allAcked = getAllBuses();
+	busMask_t a;
+
+	result_t r = llStart((addr << 1) + SoftWire::writeMode, a);
+	allAcked &= a;
+	for (size_t i = 0; i < regLen && r != SoftWire::timedOut; ++i) {
+		r = llWrite(reg[i], a);
+		allAcked &= a;
+	}
+
+	if (r != SoftWire::timedOut && allAcked) {
+		r = llRepeatedStart((addr << 1) + SoftWire::readMode, a);
+		allAcked &= a;
+
+		AsyncDelay timeout(_timeout_us, AsyncDelay::MICROS);
+		uint8_t buffer[maxBuses];
+		for (size_t i = 0; i < n && r != SoftWire::timedOut; ++i) {
+			r = llReadInner(buffer, i != n - 1, timeout);
+			for (uint8_t b = 0; b < _numBuses; ++b)
+				out[b * n + i] = buffer[b];
+		}
+	}
+
+	result_t s = stop();
+	acked = allAcked;
+	if (r == SoftWire::timedOut || s == SoftWire::timedOut)
+		return SoftWire::timedOut;
+	return (allAcked == getAllBuses() ? SoftWire::ack : SoftWire::nack);
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::llWriteInner(const uint8_t *data, busMask_t &acked, AsyncDelay &timeout) const
+{
+	acked = 0;
+	if (!SoftWireSequencer<SoftWireMulti>(*this, _cycles).writeByte(data, acked, timeout))
+		return SoftWire::timedOut;
+	return (acked == getAllBuses() ? SoftWire::ack : SoftWire::nack);
+}
+
+
+SoftWireMulti::result_t SoftWireMulti::llReadInner(uint8_t *data, bool sendAck, AsyncDelay &timeout) const
+{
+	for (uint8_t i = 0; i < _numBuses; ++i)
+		data[i] = 0;
+
+	if (!SoftWireSequencer<SoftWireMulti>(*this, _cycles).readByte(data, sendAck, timeout))
+		return SoftWire::timedOut;
+	return SoftWire::ack;
+}
@@ -0,0 +1,140 @@
+#ifndef SOFTWIREMULTI_H
+#define SOFTWIREMULTI_H
+
+#include <SoftWire.h>
+
+// Drive several identical I2C buses in parallel. The SCL lines of all
+// buses must be on one port and the SDA lines on one port (which may be
+// the same port), so that every edge on all buses is made with a single
+// port register write. All buses are clocked together; bytes and
+// acknowledgements are returned for each bus. The start, stop and
+// acknowledge sequences (shared with SoftWire through SoftWireSequencer),
+// the bus timing, the timeout and bus recovery are the same as SoftWire.
+//
+// The registers are supplied by the user, in the same way as for
+// SoftWire::setSdaPort(), and may be ordinary variables for testing.
+class SoftWireMulti {
+public:
+	typedef SoftWire::result_t result_t;
+	typedef SoftWire::portReg_t portReg_t;
+	typedef SoftWire::portValue_t portValue_t;
+
+	// Bitmask of buses, bit n is set for the nth bus added
+	typedef portValue_t busMask_t;
+
+	static const uint8_t maxBuses = sizeof(portValue_t) * 8;
+
+	SoftWireMulti(void);
+
+	void setSdaPort(portReg_t *mode, portReg_t *output, portReg_t *input);
+	void setSclPort(portReg_t *mode, portReg_t *output, portReg_t *input);
+
+	// Add a bus using the given SDA and SCL bits. Returns the bus
+	// number, or -1 if the maximum number of buses has been reached.
+	int8_t addBus(portValue_t sdaMask, portValue_t sclMask);
+
+	inline uint8_t getNumBuses(void) const {
+		return _numBuses;
+	}
+	inline busMask_t getAllBuses(void) const {
+		if (_numBuses == 0)
+			return 0;
+		return busMask_t(~busMask_t(0)) >> (maxBuses - _numBuses);
+	}
+
+	// Timing and timeouts as for SoftWire
+	inline uint8_t getDelay_us(void) const {
+		uint32_t delay_us = ((_timing.low_ns + _timing.high_ns) / 2 + 500) / 1000;
+		return (delay_us > 255 ? 255 : delay_us);
+	}
+	inline const SoftWire::timing_t& getTiming(void) const {
+		return _timing;
+	}
+	inline uint16_t getTimeout_ms(void) const {
+		return _timeout_us / 1000;
+	}
+	inline uint32_t getTimeout_us(void) const {
+		return _timeout_us;
+	}
+	inline void setDelay_us(uint8_t delay_us) {
+		setDelay_ns(delay_us * uint32_t(1000));
+	}
+	void setDelay_ns(uint32_t delay_ns);
+	void setTiming(const SoftWire::timing_t &timing);
+	inline void setTimeout_ms(uint16_t timeout_ms) {
+		_timeout_us = timeout_ms * uint32_t(1000);
+	}
+	// The timeout limits how long a slave may hold SCL low. It is
+	// restarted at each clock stretch.
+	inline void setTimeout_us(uint32_t timeout_us) {
+		_timeout_us = timeout_us;
+	}
+	inline void enablePullups(bool enable = true) {
+		_pullups = enable;
+	}
+
+	// begin() must be called before use, and after any buses are added
+	// or the pullups are changed. The buses are reset with recoverBus().
+	void begin(void) const;
+	void end(void) const; // Release all lines
+
+	// Release the buses as SoftWire::recoverBus() does. SCL is clocked
+	// until SDA is released on every bus. Called by begin() and after a
+	// timeout.
+	SoftWire::busStatus_t recoverBus(void) const;
+
+	// The same address is sent on all buses. acked is set to the buses
+	// which acknowledged. The result is nack if any bus did not
+	// acknowledge, or timedOut if SCL was held low for too long.
+	result_t llStart(uint8_t rawAddr, busMask_t &acked) const;
+	result_t llRepeatedStart(uint8_t rawAddr, busMask_t &acked) const;
+	result_t stop(void) const;
+
+	// Write the same byte to all buses
+	result_t llWrite(uint8_t data, busMask_t &acked) const;
+	// Write data[n] to bus n
+	result_t llWrite(const uint8_t *data, busMask_t &acked) const;
+	// Read a byte from each bus into data[n]
+	result_t llRead(uint8_t *data, bool sendAck = true) const;
+
+	// Write the register address and then read n bytes from every bus.
+	// The bytes from bus b are stored at out[b * n]. acked is set to the
+	// buses which acknowledged every byte.
+	result_t readRegister(uint8_t addr, const uint8_t *reg, size_t regLen,
+						  uint8_t *out, size_t n, busMask_t &acked) const;
+
+private:
+	SoftWire::port_t _sdaPort; // mask covers all SDA lines
+	SoftWire::port_t _sclPort; // mask covers all SCL lines
+	portValue_t _sdaMask[maxBuses];
+	uint8_t _numBuses;
+	bool _pullups;
+	SoftWire::timing_t _timing;
+	SoftWire::timingCycles_t _cycles;
+	uint32_t _timeout_us;
+
+	void drive(const SoftWire::port_t &port, portValue_t low) const;
+	// Drive all SDA or all SCL lines
+	inline void driveSda(uint8_t level) const {
+		drive(_sdaPort, level ? 0 : _sdaPort.mask);
+	}
+	inline void driveScl(uint8_t level) const {
+		drive(_sclPort, level ? 0 : _sclPort.mask);
+	}
+	// Wait whilst any slave holds SCL low, false on timeout. Unlike
+	// sclHighAndStretch() the bus is not reset, for use by stop().
+	bool waitForScl(AsyncDelay &timeout) const;
+	bool sclHighAndStretch(AsyncDelay &timeout) const;
+	bool sdaAllHigh(void) const;
+	result_t stopInner(AsyncDelay &timeout) const;
+	// Data and ACK bits for SoftWireSequencer, one byte per bus
+	void writeBit(const uint8_t *data, uint8_t bit) const;
+	void readBit(uint8_t *data) const;
+	void readAck(busMask_t &acked) const; // Buses where SDA is low
+	result_t llWriteInner(const uint8_t *data, busMask_t &acked, AsyncDelay &timeout) const;
+	result_t llReadInner(uint8_t *data, bool sendAck, AsyncDelay &timeout) const;
+
+	template <class Lines> friend class SoftWireSequencer;
+};
+
+#endif
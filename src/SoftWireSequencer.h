@@ -0,0 +1,214 @@
+#ifndef SOFTWIRESEQUENCER_H
+#define SOFTWIRESEQUENCER_H
+
+#include <SoftWire.h>
+
+// Bit sequencing shared by SoftWire and SoftWireMulti: the order of the
+// changes to SDA and SCL, and the delays between them, for the start,
+// repeated start and stop conditions and for each byte. The Lines class
+// changes and reads the lines, for one bus or several in parallel:
+//
+//   void driveSda(uint8_t level) const;
+//   void driveScl(uint8_t level) const;
+//   bool waitForScl(AsyncDelay &timeout) const; // false on timeout
+//   bool sclHighAndStretch(AsyncDelay &timeout) const; // resets the bus on timeout
+//   SoftWire::busStatus_t recoverBus(void) const;
+//
+// and, for the data types passed to writeByte() and readByte():
+//
+//   void writeBit(TxData data, uint8_t bit) const; // bit is 0x80 to 0x01
+//   void readAck(Ack &ack) const;
+//   void readBit(RxData &data) const; // Shift in the bit, MSB first
+//
+// The line functions may be private if the class declares
+// SoftWireSequencer a friend.
+template <class Lines>
+class SoftWireSequencer {
+public:
+	inline SoftWireSequencer(const Lines &lines, const SoftWire::timingCycles_t &cycles);
+
+	// The functions below return false on a timeout.
+
+	// SDA falls whilst SCL is high and then SCL is forced low;
+	// writeByte() provides tLOW
+	inline void start(void) const;
+	inline bool repeatedStart(AsyncDelay &timeout) const;
+	// SCL is not waited for with sclHighAndStretch(), since resetting
+	// the bus would send another stop
+	inline bool stop(AsyncDelay &timeout) const;
+
+	// Clock out the byte and read the ACK. SCL is left low.
+	template <class TxData, class Ack>
+	bool writeByte(TxData data, Ack &ack, AsyncDelay &timeout) const;
+	// Clock in the byte and send an ACK or NACK. SCL is left low.
+	template <class RxData>
+	bool readByte(RxData &data, bool sendAck, AsyncDelay &timeout) const;
+
+private:
+	const Lines &_lines;
+	const SoftWire::timingCycles_t &_cycles;
+};
+
+
+template <class Lines>
+SoftWireSequencer<Lines>::SoftWireSequencer(const Lines &lines, const SoftWire::timingCycles_t &cycles) :
+	_lines(lines),
+	_cycles(cycles)
+{
+	;
+}
+
+
+template <class Lines>
+void SoftWireSequencer<Lines>::start(void) const
+{
+	// Force SDA low
+	_lines.driveSda(LOW);
+	SoftWire::delayCycles(_cycles.hdSta);
+
+	// Force SCL low
+	_lines.driveScl(LOW);
+}
+
+
+template <class Lines>
+bool SoftWireSequencer<Lines>::repeatedStart(AsyncDelay &timeout) const
+{
+	// Force SCL low
+	_lines.driveScl(LOW);
+	SoftWire::delayCycles(_cycles.hdDat);
+
+	// Release SDA
+	_lines.driveSda(HIGH);
+	SoftWire::delayCycles(_cycles.suDat);
+
+	// Release SCL
+	if (!_lines.sclHighAndStretch(timeout))
+		return false;
+	SoftWire::delayCycles(_cycles.suSta);
+
+	// Force SDA low
+	_lines.driveSda(LOW);
+	SoftWire::delayCycles(_cycles.hdSta);
+	return true;
+}
+
+
+template <class Lines>
+bool SoftWireSequencer<Lines>::stop(AsyncDelay &timeout) const
+{
+	// Force SCL low
+	_lines.driveScl(LOW);
+	SoftWire::delayCycles(_cycles.hdDat);
+
+	// Force SDA low
+	_lines.driveSda(LOW);
+	SoftWire::delayCycles(_cycles.suDat);
+
+	// Release SCL
+	_lines.driveScl(HIGH);
+	if (!_lines.waitForScl(timeout))
+		return false;
+	SoftWire::delayCycles(_cycles.suSto);
+
+	// Release SDA
+	_lines.driveSda(HIGH);
+	SoftWire::delayCycles(_cycles.buf);
+	return true;
+}
+
+
+template <class Lines>
+template <class TxData, class Ack>
+bool SoftWireSequencer<Lines>::writeByte(TxData data, Ack &ack, AsyncDelay &timeout) const
+{
+	for (uint8_t bit = 0x80; bit; bit >>= 1) {
+		// Force SCL low
+		_lines.driveScl(LOW);
+		SoftWire::delayCycles(_cycles.hdDat);
+
+		// Set SDA
+		_lines.writeBit(data, bit);
+		SoftWire::delayCycles(_cycles.suDat);
+
+		// Release SCL
+		if (!_lines.sclHighAndStretch(timeout))
+			return false;
+		SoftWire::delayCycles(_cycles.high);
+	}
+
+	// Get ACK
+	// Force SCL low
+	_lines.driveScl(LOW);
+	SoftWire::delayCycles(_cycles.hdDat);
+
+	// Release SDA
+	_lines.driveSda(HIGH);
+	SoftWire::delayCycles(_cycles.suDat);
+
+	// Release SCL
+	if (!_lines.sclHighAndStretch(timeout))
+		return false;
+
+	_lines.readAck(ack);
+	SoftWire::delayCycles(_cycles.high);
+
+	// Keep SCL low between bytes
+	_lines.driveScl(LOW);
+	return true;
+}
+
+
+template <class Lines>
+template <class RxData>
+bool SoftWireSequencer<Lines>::readByte(RxData &data, bool sendAck, AsyncDelay &timeout) const
+{
+	for (uint8_t i = 8; i; --i) {
+		// Force SCL low
+		_lines.driveScl(LOW);
+		SoftWire::delayCycles(_cycles.hdDat);
+
+		// Release SDA (from previous ACK)
+		_lines.driveSda(HIGH);
+		SoftWire::delayCycles(_cycles.suDat);
+
+		// Release SCL
+		if (!_lines.sclHighAndStretch(timeout))
+			return false;
+		SoftWire::delayCycles(_cycles.high);
+
+		// Read clock stretch
+		if (!_lines.waitForScl(timeout)) {
+			_lines.recoverBus(); // Reset bus
+			return false;
+		}
+
+		_lines.readBit(data);
+	}
+
+	// Put ACK/NACK
+	// Force SCL low
+	_lines.driveScl(LOW);
+	SoftWire::delayCycles(_cycles.hdDat);
+
+	// Force SDA low for ACK, release it for NACK
+	_lines.driveSda(sendAck ? LOW : HIGH);
+	SoftWire::delayCycles(_cycles.suDat);
+
+	// Release SCL
+	if (!_lines.sclHighAndStretch(timeout))
+		return false;
+
+	// Wait for SCL to return high
+	if (!_lines.waitForScl(timeout)) {
+		_lines.recoverBus(); // Reset bus
+		return false;
+	}
+	SoftWire::delayCycles(_cycles.high);
+
+	// Keep SCL low between bytes
+	_lines.driveScl(LOW);
+	return true;
+}
+
+#endif
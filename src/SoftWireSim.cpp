@@ -0,0 +1,512 @@
+#include <SoftWireSim.h>
+
+
+SoftWireSim::SoftWireSim(void) :
+	_numDevices(0),
+	_active(NULL),
+	_trace(NULL),
+	_masterSda(HIGH),
+	_masterScl(HIGH),
+	_slaveSda(HIGH),
+	_slaveScl(HIGH),
+	_stretch(0),
+	_state(idle),
+	_mode(SoftWire::writeMode),
+	_shift(0),
+	_bit(0),
+	_masterAck(false)
+{
+	resetStats();
+}
+
+
+void SoftWireSim::attach(SoftWire &sw)
+{
+	sw.setContext(this);
+	sw.setSetSdaLow(sdaLow);
+	sw.setSetSdaHigh(sdaHigh);
+	sw.setSetSclLow(sclLow);
+	sw.setSetSclHigh(sclHigh);
+	sw.setReadSda(readSda);
+	sw.setReadScl(readScl);
+}
+
+
+bool SoftWireSim::addDevice(SoftWireSimDevice &device)
+{
+	if (_numDevices >= maxDevices)
+		return false;
+	_devices[_numDevices++] = &device;
+	return true;
+}
+
+
+void SoftWireSim::resetStats(void)
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+
+void SoftWireSim::setMasterSda(uint8_t level)
+{
+	if (level)
+		++_stats.sdaHigh;
+	else
+		++_stats.sdaLow;
+	if (level == _masterSda)
+		return;
+
+	++_stats.edges;
+	uint8_t oldSda = getSda();
+	uint8_t oldScl = getScl();
+	_masterSda = level;
+	busChanged(oldSda, oldScl);
+}
+
+
+void SoftWireSim::setMasterScl(uint8_t level)
+{
+	if (level)
+		++_stats.sclHigh;
+	else
+		++_stats.sclLow;
+	if (level == _masterScl)
+		return;
+
+	++_stats.edges;
+	uint8_t oldSda = getSda();
+	uint8_t oldScl = getScl();
+	_masterScl = level;
+	busChanged(oldSda, oldScl);
+}
+
+
+uint8_t SoftWireSim::readSda(void)
+{
+	++_stats.readSda;
+	return getSda();
+}
+
+
+uint8_t SoftWireSim::readScl(void)
+{
+	++_stats.readScl;
+	if (_stretch && --_stretch == 0) {
+		// Slave releases SCL
+		uint8_t oldSda = getSda();
+		uint8_t oldScl = getScl();
+		_slaveScl = HIGH;
+		busChanged(oldSda, oldScl);
+	}
+	return getScl();
+}
+
+
+void SoftWireSim::sdaLow(const SoftWire *p)
+{
+	((SoftWireSim*)p->getContext())->setMasterSda(LOW);
+}
+
+
+void SoftWireSim::sdaHigh(const SoftWire *p)
+{
+	((SoftWireSim*)p->getContext())->setMasterSda(HIGH);
+}
+
+
+void SoftWireSim::sclLow(const SoftWire *p)
+{
+	((SoftWireSim*)p->getContext())->setMasterScl(LOW);
+}
+
+
+void SoftWireSim::sclHigh(const SoftWire *p)
+{
+	((SoftWireSim*)p->getContext())->setMasterScl(HIGH);
+}
+
+
+uint8_t SoftWireSim::readSda(const SoftWire *p)
+{
+	return ((SoftWireSim*)p->getContext())->readSda();
+}
+
+
+uint8_t SoftWireSim::readScl(const SoftWire *p)
+{
+	return ((SoftWireSim*)p->getContext())->readScl();
+}
+
+
+void SoftWireSim::busChanged(uint8_t oldSda, uint8_t oldScl)
+{
+	uint8_t sda = getSda();
+	uint8_t scl = getScl();
+	if (sda == oldSda && scl == oldScl)
+		return;
+
+	if (_trace)
+		(*_trace)(sda, scl);
+
+	if (oldScl && scl) {
+		if (oldSda && !sda) {
+			// Start or repeated start
+			++_stats.starts;
+			_state = address;
+			_shift = 0;
+			_bit = 0;
+			_slaveSda = HIGH;
+		}
+		else if (!oldSda && sda) {
+			// Stop
+			++_stats.stops;
+			if (_active)
+				_active->stop();
+			_active = NULL;
+			_state = idle;
+			_slaveSda = HIGH;
+		}
+	}
+	else if (!oldScl && scl)
+		sclRising(sda);
+	else if (oldScl && !scl)
+		sclFalling();
+}
+
+
+void SoftWireSim::sclRising(uint8_t sda)
+{
+	switch (_state) {
+	case address:
+	case receive:
+		_shift = (_shift << 1) | (sda ? 1 : 0);
+		++_bit;
+		break;
+
+	case transmitAck:
+		_masterAck = (sda == LOW);
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+// Slaves change SDA only whilst SCL is low
+void SoftWireSim::sclFalling(void)
+{
+	switch (_state) {
+	case idle:
+		break;
+
+	case address:
+		if (_bit == 8) {
+			SoftWireSimDevice *device = NULL;
+			for (uint8_t i = 0; i < _numDevices; ++i)
+				if (_devices[i]->getAddress() == (_shift >> 1))
+					device = _devices[i];
+
+			if (_active && _active != device)
+				_active->stop();
+			_mode = (_shift & 1) ? SoftWire::readMode : SoftWire::writeMode;
+			if (device && device->start(_mode)) {
+				_active = device;
+				acknowledge();
+				_state = addressAck;
+			}
+			else {
+				// NACK, ignore the bus until the next start
+				_active = NULL;
+				_state = idle;
+			}
+		}
+		break;
+
+	case addressAck:
+		_slaveSda = HIGH;
+		if (_mode == SoftWire::readMode) {
+			loadTransmit();
+			_state = transmit;
+		}
+		else {
+			_shift = 0;
+			_bit = 0;
+			_state = receive;
+		}
+		break;
+
+	case receive:
+		if (_bit == 8) {
+			++_stats.bytes;
+			if (_active->write(_shift))
+				acknowledge();
+			_state = receiveAck;
+		}
+		break;
+
+	case receiveAck:
+		_slaveSda = HIGH;
+		_shift = 0;
+		_bit = 0;
+		_state = receive;
+		break;
+
+	case transmit:
+		if (_bit < 8) {
+			_slaveSda = (_shift >> (7 - _bit)) & 1;
+			++_bit;
+		}
+		else {
+			// Release SDA for the master to acknowledge
+			++_stats.bytes;
+			_slaveSda = HIGH;
+			_state = transmitAck;
+		}
+		break;
+
+	case transmitAck:
+		if (_masterAck) {
+			loadTransmit();
+			_state = transmit;
+		}
+		else
+			_state = idle; // Master has finished reading
+		break;
+	}
+}
+
+
+// Fetch the next byte from the device and put its MSB onto SDA
+void SoftWireSim::loadTransmit(void)
+{
+	_shift = _active->read();
+	_slaveSda = (_shift & 0x80) ? HIGH : LOW;
+	_bit = 1;
+}
+
+
+void SoftWireSim::acknowledge(void)
+{
+	_slaveSda = LOW;
+	_stretch = _active->getStretch();
+	if (_stretch)
+		_slaveScl = LOW;
+}
+
+
+SoftWireSimDevice::SoftWireSimDevice(uint8_t address) :
+	_address(address),
+	_stretch(0)
+{
+	;
+}
+
+
+bool SoftWireSimDevice::start(SoftWire::mode_t /* mode */)
+{
+	return true;
+}
+
+
+void SoftWireSimDevice::stop(void)
+{
+	;
+}
+
+
+SoftWireSimRegisters::SoftWireSimRegisters(uint8_t address, uint8_t *registers, size_t size) :
+	SoftWireSimDevice(address),
+	_registers(registers),
+	_size(size),
+	_pointer(0),
+	_pointerNext(false)
+{
+	;
+}
+
+
+bool SoftWireSimRegisters::start(SoftWire::mode_t mode)
+{
+	_pointerNext = (mode == SoftWire::writeMode);
+	return true;
+}
+
+
+bool SoftWireSimRegisters::write(uint8_t data)
+{
+	if (_pointerNext) {
+		_pointer = data % _size;
+		_pointerNext = false;
+	}
+	else {
+		_registers[_pointer] = data;
+		_pointer = (_pointer + 1) % _size;
+	}
+	return true;
+}
+
+
+uint8_t SoftWireSimRegisters::read(void)
+{
+	uint8_t data = _registers[_pointer];
+	_pointer = (_pointer + 1) % _size;
+	return data;
+}
+
+
+SoftWireSimEeprom::SoftWireSimEeprom(uint8_t address, uint8_t *memory, size_t size,
+									 uint16_t pageSize, uint8_t addressBytes,
+									 uint16_t writeCycle_us) :
+	SoftWireSimDevice(address),
+	_memory(memory),
+	_size(size),
+	_pageSize(pageSize),
+	_addressBytes(addressBytes),
+	_writeCycle_us(writeCycle_us),
+	_pointer(0),
+	_addressCount(0),
+	_written(false),
+	_busy(false),
+	_writeStart_us(0)
+{
+	;
+}
+
+
+bool SoftWireSimEeprom::start(SoftWire::mode_t mode)
+{
+	if (isBusy())
+		return false; // Write cycle in progress
+	_busy = false;
+
+	if (mode == SoftWire::writeMode) {
+		_addressCount = _addressBytes;
+		_written = false;
+	}
+	return true;
+}
+
+
+bool SoftWireSimEeprom::write(uint8_t data)
+{
+	if (_addressCount) {
+		if (_addressCount == _addressBytes)
+			_pointer = 0;
+		_pointer = (_pointer << 8) | data;
+		if (--_addressCount == 0)
+			_pointer %= _size;
+		return true;
+	}
+
+	// Wrap within the page
+	_memory[_pointer] = data;
+	size_t pageStart = _pointer - (_pointer % _pageSize);
+	_pointer = pageStart + ((_pointer + 1) % _pageSize);
+	_written = true;
+	return true;
+}
+
+
+uint8_t SoftWireSimEeprom::read(void)
+{
+	uint8_t data = _memory[_pointer];
+	_pointer = (_pointer + 1) % _size;
+	return data;
+}
+
+
+void SoftWireSimEeprom::stop(void)
+{
+	if (_written) {
+		_written = false;
+		_busy = true;
+		_writeStart_us = micros();
+	}
+}
+
+
+SoftWireSimSmBus::SoftWireSimSmBus(uint8_t address, uint16_t *words, uint8_t numWords) :
+	SoftWireSimDevice(address),
+	_words(words),
+	_numWords(numWords),
+	_command(0),
+	_count(0),
+	_pec(0),
+	_data(0)
+{
+	;
+}
+
+
+bool SoftWireSimSmBus::start(SoftWire::mode_t mode)
+{
+	uint8_t rawAddr = (getAddress() << 1) + mode;
+	if (mode == SoftWire::writeMode)
+		_pec = 0; // New transaction
+	else
+		_data = (_command < _numWords ? _words[_command] : 0xFFFF);
+	_pec = SoftWire::crc8_update(_pec, rawAddr);
+	_count = 0;
+	return true;
+}
+
+
+bool SoftWireSimSmBus::write(uint8_t data)
+{
+	uint8_t pec = _pec;
+	_pec = SoftWire::crc8_update(_pec, data);
+
+	switch (_count++) {
+	case 0:
+		_command = data;
+		return _command < _numWords;
+
+	case 1:
+		_data = data;
+		return true;
+
+	case 2:
+		_data |= uint16_t(data) << 8;
+		return true;
+
+	case 3:
+		if (data != pec)
+			return false;
+		_words[_command] = _data;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+
+uint8_t SoftWireSimSmBus::read(void)
+{
+	uint8_t data;
+	switch (_count++) {
+	case 0:
+		data = _data & 0xFF;
+		break;
+
+	case 1:
+		data = _data >> 8;
+		break;
+
+	case 2:
+		return _pec;
+
+	default:
+		return 0xFF;
+	}
+
+	_pec = SoftWire::crc8_update(_pec, data);
+	return data;
+}
+
+
+void SoftWireSimSmBus::stop(void)
+{
+	_count = 0;
+}
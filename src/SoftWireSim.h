@@ -0,0 +1,219 @@
+#ifndef SOFTWIRESIM_H
+#define SOFTWIRESIM_H
+
+#include <SoftWire.h>
+
+// Simulated I2C bus and slave devices, for testing and benchmarking
+// without hardware. SoftWireSim models the open-drain, wired-AND SDA and
+// SCL lines. attach() replaces the line drivers of a SoftWire object so
+// that every change to and every read of SDA and SCL is made on the
+// simulated bus and counted. Slave devices decode the bus one bit at a
+// time, as real devices do.
+
+class SoftWireSimDevice;
+
+class SoftWireSim {
+public:
+	static const uint8_t maxDevices = 8;
+
+	// Counts of line driver calls and bus events
+	struct stats_t {
+		uint32_t sdaLow;
+		uint32_t sdaHigh;
+		uint32_t sclLow;
+		uint32_t sclHigh;
+		uint32_t readSda;
+		uint32_t readScl;
+		uint32_t edges; // Changes of the master's SDA or SCL output
+		uint32_t starts; // Includes repeated starts
+		uint32_t stops;
+		uint32_t bytes; // Bytes acknowledged or not, excluding addresses
+	};
+
+	SoftWireSim(void);
+
+	// Use the simulated bus for sw. This sets the line drivers and the
+	// context of sw.
+	void attach(SoftWire &sw);
+
+	// Return false if maxDevices have already been added
+	bool addDevice(SoftWireSimDevice &device);
+
+	inline const stats_t& getStats(void) const {
+		return _stats;
+	}
+	void resetStats(void);
+
+	// Function called after every change of SDA or SCL
+	inline void setTrace(void (*trace)(uint8_t sda, uint8_t scl)) {
+		_trace = trace;
+	}
+
+	// Bus levels
+	inline uint8_t getSda(void) const {
+		return _masterSda & _slaveSda;
+	}
+	inline uint8_t getScl(void) const {
+		return _masterScl & _slaveScl;
+	}
+
+	// Master side of the bus, for line drivers other than SoftWire's
+	void setMasterSda(uint8_t level);
+	void setMasterScl(uint8_t level);
+	uint8_t readSda(void);
+	uint8_t readScl(void);
+
+	static void sdaLow(const SoftWire *p);
+	static void sdaHigh(const SoftWire *p);
+	static void sclLow(const SoftWire *p);
+	static void sclHigh(const SoftWire *p);
+	static uint8_t readSda(const SoftWire *p);
+	static uint8_t readScl(const SoftWire *p);
+
+private:
+	enum state_t {
+		idle = 0, // Not addressed, wait for start
+		address,
+		addressAck,
+		receive,
+		receiveAck,
+		transmit,
+		transmitAck,
+	};
+
+	SoftWireSimDevice *_devices[maxDevices];
+	uint8_t _numDevices;
+	SoftWireSimDevice *_active;
+	stats_t _stats;
+	void (*_trace)(uint8_t sda, uint8_t scl);
+
+	uint8_t _masterSda;
+	uint8_t _masterScl;
+	uint8_t _slaveSda;
+	uint8_t _slaveScl;
+	uint16_t _stretch; // Remaining reads of SCL for which it is held low
+
+	state_t _state;
+	SoftWire::mode_t _mode;
+	uint8_t _shift;
+	uint8_t _bit;
+	bool _masterAck;
+
+	void busChanged(uint8_t oldSda, uint8_t oldScl);
+	void sclRising(uint8_t sda);
+	void sclFalling(void);
+	void loadTransmit(void);
+	void acknowledge(void);
+};
+
+
+// Base class for simulated slave devices. The functions are called as
+// the bus is decoded.
+class SoftWireSimDevice {
+public:
+	SoftWireSimDevice(uint8_t address);
+
+	inline uint8_t getAddress(void) const {
+		return _address;
+	}
+
+	// Hold SCL low for the given number of reads of SCL after every
+	// acknowledge bit, to simulate a clock-stretching device
+	inline void setStretch(uint16_t reads) {
+		_stretch = reads;
+	}
+	inline uint16_t getStretch(void) const {
+		return _stretch;
+	}
+
+	// Called at every start or repeated start addressed to the device.
+	// Return false to NACK the address.
+	virtual bool start(SoftWire::mode_t mode);
+	// Byte written by the master, return false to NACK
+	virtual bool write(uint8_t data) = 0;
+	// Byte to be read by the master
+	virtual uint8_t read(void) = 0;
+	// Called at a stop after the device was addressed
+	virtual void stop(void);
+
+private:
+	uint8_t _address;
+	uint16_t _stretch;
+};
+
+
+// Device with a file of registers. The first byte written sets the
+// register pointer, which auto-increments on every read and write.
+class SoftWireSimRegisters : public SoftWireSimDevice {
+public:
+	SoftWireSimRegisters(uint8_t address, uint8_t *registers, size_t size);
+
+	virtual bool start(SoftWire::mode_t mode);
+	virtual bool write(uint8_t data);
+	virtual uint8_t read(void);
+
+private:
+	uint8_t *_registers;
+	size_t _size;
+	size_t _pointer;
+	bool _pointerNext;
+};
+
+
+// 24Cxx-type EEPROM. The first addressBytes bytes written set the memory
+// address. Writes wrap within the current page. After a stop which
+// follows a write the device does not acknowledge its address until the
+// write cycle time has elapsed.
+class SoftWireSimEeprom : public SoftWireSimDevice {
+public:
+	static const uint16_t defaultWriteCycle_us = 5000;
+
+	SoftWireSimEeprom(uint8_t address, uint8_t *memory, size_t size,
+					  uint16_t pageSize, uint8_t addressBytes,
+					  uint16_t writeCycle_us = defaultWriteCycle_us);
+
+	inline bool isBusy(void) const {
+		return _busy && micros() - _writeStart_us < _writeCycle_us;
+	}
+
+	virtual bool start(SoftWire::mode_t mode);
+	virtual bool write(uint8_t data);
+	virtual uint8_t read(void);
+	virtual void stop(void);
+
+private:
+	uint8_t *_memory;
+	size_t _size;
+	uint16_t _pageSize;
+	uint8_t _addressBytes;
+	uint16_t _writeCycle_us;
+	size_t _pointer;
+	uint8_t _addressCount; // Address bytes still to be received
+	bool _written;
+	bool _busy;
+	unsigned long _writeStart_us;
+};
+
+
+// SMBus device in the style of the MLX90614. Each command reads or writes
+// a 16-bit word, low byte first, followed by a PEC. Writes with an
+// invalid PEC are not acknowledged and are discarded.
+class SoftWireSimSmBus : public SoftWireSimDevice {
+public:
+	SoftWireSimSmBus(uint8_t address, uint16_t *words, uint8_t numWords);
+
+	virtual bool start(SoftWire::mode_t mode);
+	virtual bool write(uint8_t data);
+	virtual uint8_t read(void);
+	virtual void stop(void);
+
+private:
+	uint16_t *_words;
+	uint8_t _numWords;
+	uint8_t _command;
+	uint8_t _count; // Bytes transferred since the last start
+	uint8_t _pec;
+	uint16_t _data;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include <SoftWireSmBus.h>
+
+
+SoftWireSmBus::SoftWireSmBus(SoftWire &sw, uint8_t address, bool pec) :
+	_sw(sw),
+	_address(address),
+	_pecEnabled(pec)
+{
+	;
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::quickCommand(SoftWire::mode_t mode)
+{
+	// No PEC for Quick Command
+	SoftWire::result_t r = _sw.start(_address, mode);
+	SoftWire::result_t s = _sw.stop();
+	return status_t(r == SoftWire::ack ? s : r);
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::sendByte(uint8_t data)
+{
+	SoftWire::span_t span = {&data, 1};
+	return transaction(&span, 1, NULL, 0, NULL);
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::receiveByte(uint8_t &data)
+{
+	return transaction(NULL, 0, &data, 1, NULL);
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::writeByte(uint8_t command, uint8_t data)
+{
+	uint8_t buffer[2] = {command, data};
+	SoftWire::span_t span = {buffer, sizeof(buffer)};
+	return transaction(&span, 1, NULL, 0, NULL);
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::writeWord(uint8_t command, uint16_t data)
+{
+	uint8_t buffer[3] = {command, uint8_t(data), uint8_t(data >> 8)};
+	SoftWire::span_t span = {buffer, sizeof(buffer)};
+	return transaction(&span, 1, NULL, 0, NULL);
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::readByte(uint8_t command, uint8_t &data)
+{
+	SoftWire::span_t span = {&command, 1};
+	return transaction(&span, 1, &data, 1, NULL);
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::readWord(uint8_t command, uint16_t &data)
+{
+	SoftWire::span_t span = {&command, 1};
+	uint8_t buffer[2];
+	status_t r = transaction(&span, 1, buffer, sizeof(buffer), NULL);
+	if (r == ok)
+		data = toWord(buffer);
+	return r;
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::processCall(uint8_t command, uint16_t data, uint16_t &result)
+{
+	uint8_t buffer[3] = {command, uint8_t(data), uint8_t(data >> 8)};
+	SoftWire::span_t span = {buffer, sizeof(buffer)};
+	status_t r = transaction(&span, 1, buffer, 2, NULL);
+	if (r == ok)
+		result = toWord(buffer);
+	return r;
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::blockWrite(uint8_t command, const uint8_t *data, uint8_t count)
+{
+	uint8_t header[2] = {command, count};
+	SoftWire::span_t spans[2] = {
+		{header, sizeof(header)},
+		{data, count},
+	};
+	return transaction(spans, 2, NULL, 0, NULL);
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::blockRead(uint8_t command, uint8_t *data, uint8_t size, uint8_t &count)
+{
+	SoftWire::span_t span = {&command, 1};
+	return transaction(&span, 1, data, size, &count);
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::blockProcessCall(uint8_t command, const uint8_t *data, uint8_t writeCount,
+														uint8_t *result, uint8_t size, uint8_t &readCount)
+{
+	uint8_t header[2] = {command, writeCount};
+	SoftWire::span_t spans[2] = {
+		{header, sizeof(header)},
+		{data, writeCount},
+	};
+	return transaction(spans, 2, result, size, &readCount);
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::transaction(const SoftWire::span_t *spans, uint8_t numSpans,
+												   uint8_t *data, uint8_t len, uint8_t *count)
+{
+	bool pecWasEnabled = _sw.isPecEnabled();
+	_sw.enablePec(_pecEnabled); // Also clears the PEC
+	status_t r = transactionInner(spans, numSpans, data, len, count);
+	_sw.enablePec(pecWasEnabled);
+	return r;
+}
+
+
+SoftWireSmBus::status_t SoftWireSmBus::transactionInner(const SoftWire::span_t *spans, uint8_t numSpans,
+														uint8_t *data, uint8_t len, uint8_t *count)
+{
+	SoftWire::result_t r = _sw.start(_address, numSpans ? SoftWire::writeMode : SoftWire::readMode);
+	for (uint8_t i = 0; i < numSpans && r == SoftWire::ack; ++i)
+		r = _sw.llWriteBuffer(spans[i].data, spans[i].len);
+
+	if (data == NULL) {
+		// Write only
+		if (r == SoftWire::ack && _pecEnabled)
+			r = _sw.llWrite(_sw.getPec());
+		SoftWire::result_t s = _sw.stop();
+		return status_t(r == SoftWire::ack ? s : r);
+	}
+
+	if (r == SoftWire::ack && numSpans)
+		r = _sw.repeatedStart(_address, SoftWire::readMode);
+
+	status_t status = status_t(r);
+	if (status == ok && count) {
+		// The count must be acknowledged before it is known
+		uint8_t n;
+		r = _sw.llRead(n, true);
+		status = status_t(r);
+		if (status == ok) {
+			if (n > len) {
+				status = blockSizeError;
+				n = 0;
+			}
+			*count = n;
+			len = n;
+		}
+	}
+
+	// Every byte is acknowledged except the last, which may be the PEC
+	if (status == ok && len)
+		status = status_t(_sw.llReadBuffer(data, len, !_pecEnabled));
+	if ((status == ok || status == blockSizeError) && (_pecEnabled || len == 0)) {
+		// Read the PEC, or for an empty or rejected block a byte which
+		// is only read to NACK it
+		uint8_t pec;
+		r = _sw.llRead(pec, false);
+		if (status == ok) {
+			status = status_t(r);
+			if (status == ok && _pecEnabled && _sw.getPec())
+				status = pecError;
+		}
+	}
+
+	SoftWire::result_t s = _sw.stop();
+	return (status == ok ? status_t(s) : status);
+}
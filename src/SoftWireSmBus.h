@@ -0,0 +1,82 @@
+#ifndef SOFTWIRESMBUS_H
+#define SOFTWIRESMBUS_H
+
+#include <SoftWire.h>
+
+// SMBus protocols for one device. Each function performs a complete
+// transaction and returns a single status. When PEC is enabled it is
+// calculated by SoftWire as the bytes are clocked: it is appended to
+// writes, and for reads the PEC byte is read and checked before the
+// stop. Words are sent and received low byte first.
+//
+// The PEC setting of the SoftWire object is changed for the duration of
+// each transaction and then restored, so other devices on the bus are
+// not affected.
+class SoftWireSmBus {
+public:
+	// The first three values match SoftWire::result_t
+	enum status_t {
+		ok = 0,
+		nack = 1,
+		timedOut = 2,
+		pecError = 3, // PEC of a read did not match
+		blockSizeError = 4, // Block read count larger than the buffer
+	};
+
+	SoftWireSmBus(SoftWire &sw, uint8_t address, bool pec = false);
+
+	inline SoftWire& getSoftWire(void) const {
+		return _sw;
+	}
+	inline uint8_t getAddress(void) const {
+		return _address;
+	}
+	inline void enablePec(bool enable = true) {
+		_pecEnabled = enable;
+	}
+	inline bool isPecEnabled(void) const {
+		return _pecEnabled;
+	}
+
+	// The address only, with the stop after the ACK bit. No PEC.
+	status_t quickCommand(SoftWire::mode_t mode);
+
+	status_t sendByte(uint8_t data);
+	status_t receiveByte(uint8_t &data);
+
+	status_t writeByte(uint8_t command, uint8_t data);
+	status_t writeWord(uint8_t command, uint16_t data);
+	status_t readByte(uint8_t command, uint8_t &data);
+	status_t readWord(uint8_t command, uint16_t &data);
+
+	// Write a word then read a word, in one transaction
+	status_t processCall(uint8_t command, uint16_t data, uint16_t &result);
+
+	// Block transfers are preceded by a byte count. For reads size is the
+	// size of the buffer and count is set to the number of bytes
+	// received; if the device sends a larger count the read is ended
+	// early and blockSizeError returned.
+	status_t blockWrite(uint8_t command, const uint8_t *data, uint8_t count);
+	status_t blockRead(uint8_t command, uint8_t *data, uint8_t size, uint8_t &count);
+	status_t blockProcessCall(uint8_t command, const uint8_t *data, uint8_t writeCount,
+							  uint8_t *result, uint8_t size, uint8_t &readCount);
+
+private:
+	SoftWire &_sw;
+	uint8_t _address;
+	bool _pecEnabled;
+
+	static inline uint16_t toWord(const uint8_t *p) {
+		return p[0] | (uint16_t(p[1]) << 8);
+	}
+
+	// Write the spans (none for Receive Byte), then after a repeated
+	// start read len bytes into data, unless data is null. If count is
+	// not null the read is a block read with a maximum of len bytes.
+	status_t transaction(const SoftWire::span_t *spans, uint8_t numSpans,
+						 uint8_t *data, uint8_t len, uint8_t *count);
+	status_t transactionInner(const SoftWire::span_t *spans, uint8_t numSpans,
+							  uint8_t *data, uint8_t len, uint8_t *count);
+};
+
+#endif
@@ -0,0 +1,412 @@
+#ifndef SOFTWIRET_H
+#define SOFTWIRET_H
+
+// SoftWireT is a compile-time specialisation of the SoftWire low-level
+// functions. The SDA and SCL pins and the functions which control and
+// read them are template parameters, so the compiler can inline every
+// edge instead of calling through function pointers. Use SoftWire when
+// the pins or line drivers must be configured at run-time.
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <util/atomic.h>
+#endif
+
+#include <SoftWire.h>
+
+
+// Default backend, using the Wiring pin functions. A backend must provide
+// static low(), release() and read() member templates which take the pin
+// number as their template parameter.
+template <bool pullups = false>
+class SoftWireDigitalBackend {
+public:
+	// Force pin low
+	template <uint8_t pin> static inline void low(void) {
+#ifdef ATOMIC_BLOCK
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+		{
+			digitalWrite(pin, LOW);
+			pinMode(pin, OUTPUT);
+		}
+	}
+
+	// Release pin to float high
+	template <uint8_t pin> static inline void release(void) {
+		pinMode(pin, pullups ? INPUT_PULLUP : INPUT);
+	}
+
+	template <uint8_t pin> static inline uint8_t read(void) {
+		return digitalRead(pin);
+	}
+};
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend = SoftWireDigitalBackend<> >
+class SoftWireT {
+public:
+	typedef SoftWire::result_t result_t;
+	typedef SoftWire::mode_t mode_t;
+
+	SoftWireT(void);
+	inline uint8_t getSda(void) const {
+		return sdaPin;
+	}
+	inline uint8_t getScl(void) const {
+		return sclPin;
+	}
+	inline uint8_t getDelay_us(void) const {
+		return _delay_us;
+	}
+	inline uint16_t getTimeout_ms(void) const {
+		return _timeout_ms;
+	}
+
+	inline void setDelay_us(uint8_t delay_us) {
+		_delay_us = delay_us;
+	}
+	inline void setTimeout_ms(uint16_t timeout_ms) {
+		_timeout_ms = timeout_ms;
+	}
+
+	void begin(void) const;
+	void end(void) const; // Release pins
+
+	// Functions which take raw addresses (ie address passed must
+	// already indicate read/write mode)
+	result_t llStart(uint8_t rawAddr) const;
+	result_t llRepeatedStart(uint8_t rawAddr) const;
+	result_t llStartWait(uint8_t rawAddr) const;
+
+	result_t stop(void) const;
+
+	inline result_t startRead(uint8_t addr) const {
+		return llStart((addr << 1) + SoftWire::readMode);
+	}
+	inline result_t startWrite(uint8_t addr) const {
+		return llStart((addr << 1) + SoftWire::writeMode);
+	}
+	inline result_t repeatedStartRead(uint8_t addr) const {
+		return llRepeatedStart((addr << 1) + SoftWire::readMode);
+	}
+	inline result_t repeatedStartWrite(uint8_t addr) const {
+		return llRepeatedStart((addr << 1) + SoftWire::writeMode);
+	}
+	inline result_t startReadWait(uint8_t addr) const {
+		return llStartWait((addr << 1) + SoftWire::readMode);
+	}
+	inline result_t startWriteWait(uint8_t addr) const {
+		return llStartWait((addr << 1) + SoftWire::writeMode);
+	}
+
+	inline result_t start(uint8_t addr, mode_t rwMode) const {
+		return llStart((addr << 1) + rwMode);
+	}
+	inline result_t repeatedStart(uint8_t addr, mode_t rwMode) const {
+		return llRepeatedStart((addr << 1) + rwMode);
+	}
+	inline result_t startWait(uint8_t addr, mode_t rwMode) const {
+		return llStartWait((addr << 1) + rwMode);
+	}
+
+	result_t llWrite(uint8_t data) const;
+	result_t llRead(uint8_t &data, bool sendAck = true) const;
+	inline result_t readThenAck(uint8_t &data) const {
+		return llRead(data, true);
+	}
+	inline result_t readThenNack(uint8_t &data) const {
+		return llRead(data, false);
+	}
+
+	static inline void sdaLow(void) {
+		Backend::template low<sdaPin>();
+	}
+	static inline void sdaHigh(void) {
+		Backend::template release<sdaPin>();
+	}
+	static inline void sclLow(void) {
+		Backend::template low<sclPin>();
+	}
+	static inline void sclHigh(void) {
+		Backend::template release<sclPin>();
+	}
+	static inline uint8_t readSda(void) {
+		return Backend::template read<sdaPin>();
+	}
+	static inline uint8_t readScl(void) {
+		return Backend::template read<sclPin>();
+	}
+	inline bool sclHighAndStretch(AsyncDelay& timeout) const;
+
+private:
+	uint8_t _delay_us;
+	uint16_t _timeout_ms;
+
+	// Wait for SCL to be released, without resetting the bus
+	inline bool waitForScl(AsyncDelay& timeout) const;
+};
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+SoftWireT<sdaPin, sclPin, Backend>::SoftWireT(void) :
+	_delay_us(SoftWire::defaultDelay_us),
+	_timeout_ms(SoftWire::defaultTimeout_ms)
+{
+	;
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+void SoftWireT<sdaPin, sclPin, Backend>::begin(void) const
+{
+	stop();
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+void SoftWireT<sdaPin, sclPin, Backend>::end(void) const
+{
+	sdaHigh();
+	sclHigh();
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+bool SoftWireT<sdaPin, sclPin, Backend>::sclHighAndStretch(AsyncDelay& timeout) const
+{
+	sclHigh();
+	if (!waitForScl(timeout)) {
+		stop(); // Reset bus
+		return false;
+	}
+	return true;
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+bool SoftWireT<sdaPin, sclPin, Backend>::waitForScl(AsyncDelay& timeout) const
+{
+	// Wait for SCL to actually become high in case the slave keeps
+	// it low (clock stretching).
+	while (readScl() == LOW)
+		if (timeout.isExpired())
+			return false;
+
+	return true;
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+typename SoftWireT<sdaPin, sclPin, Backend>::result_t SoftWireT<sdaPin, sclPin, Backend>::stop(void) const
+{
+	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
+
+	// Force SCL low
+	sclLow();
+	delayMicroseconds(_delay_us);
+
+	// Force SDA low
+	sdaLow();
+	delayMicroseconds(_delay_us);
+
+	// Release SCL. Don't reset the bus if it is held, stop() is the
+	// reset.
+	sclHigh();
+	if (!waitForScl(timeout))
+		return SoftWire::timedOut;
+	delayMicroseconds(_delay_us);
+
+	// Release SDA
+	sdaHigh();
+	delayMicroseconds(_delay_us);
+
+	return SoftWire::ack;
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+typename SoftWireT<sdaPin, sclPin, Backend>::result_t SoftWireT<sdaPin, sclPin, Backend>::llStart(uint8_t rawAddr) const
+{
+	// Force SDA low
+	sdaLow();
+	delayMicroseconds(_delay_us);
+
+	// Force SCL low
+	sclLow();
+	delayMicroseconds(_delay_us);
+	return llWrite(rawAddr);
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+typename SoftWireT<sdaPin, sclPin, Backend>::result_t SoftWireT<sdaPin, sclPin, Backend>::llRepeatedStart(uint8_t rawAddr) const
+{
+	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
+
+	// Force SCL low
+	sclLow();
+	delayMicroseconds(_delay_us);
+
+	// Release SDA
+	sdaHigh();
+	delayMicroseconds(_delay_us);
+
+	// Release SCL
+	if (!sclHighAndStretch(timeout))
+		return SoftWire::timedOut;
+	delayMicroseconds(_delay_us);
+
+	// Force SDA low
+	sdaLow();
+	delayMicroseconds(_delay_us);
+
+	return llWrite(rawAddr);
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+typename SoftWireT<sdaPin, sclPin, Backend>::result_t SoftWireT<sdaPin, sclPin, Backend>::llStartWait(uint8_t rawAddr) const
+{
+	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
+
+	while (!timeout.isExpired()) {
+		// Force SDA low
+		sdaLow();
+		delayMicroseconds(_delay_us);
+
+		switch (llWrite(rawAddr)) {
+		case SoftWire::ack:
+			return SoftWire::ack;
+		case SoftWire::nack:
+			stop();
+			break;
+		default:
+			// timeout, and anything else we don't know about
+			stop();
+			return SoftWire::timedOut;
+		}
+	}
+	return SoftWire::timedOut;
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+typename SoftWireT<sdaPin, sclPin, Backend>::result_t SoftWireT<sdaPin, sclPin, Backend>::llWrite(uint8_t data) const
+{
+	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
+	for (uint8_t i = 8; i; --i) {
+		// Force SCL low
+		sclLow();
+
+		if (data & 0x80) {
+			// Release SDA
+			sdaHigh();
+		}
+		else {
+			// Force SDA low
+			sdaLow();
+		}
+		delayMicroseconds(_delay_us);
+
+		// Release SCL
+		if (!sclHighAndStretch(timeout))
+			return SoftWire::timedOut;
+
+		delayMicroseconds(_delay_us);
+
+		data <<= 1;
+	}
+
+	// Get ACK
+	// Force SCL low
+	sclLow();
+
+	// Release SDA
+	sdaHigh();
+
+	delayMicroseconds(_delay_us);
+
+	// Release SCL
+	if (!sclHighAndStretch(timeout))
+		return SoftWire::timedOut;
+
+	result_t res = (readSda() == LOW ? SoftWire::ack : SoftWire::nack);
+
+	delayMicroseconds(_delay_us);
+
+	// Keep SCL low between bytes
+	sclLow();
+
+	return res;
+}
+
+
+template <uint8_t sdaPin, uint8_t sclPin, class Backend>
+typename SoftWireT<sdaPin, sclPin, Backend>::result_t SoftWireT<sdaPin, sclPin, Backend>::llRead(uint8_t &data, bool sendAck) const
+{
+	data = 0;
+	AsyncDelay timeout(_timeout_ms, AsyncDelay::MILLIS);
+
+	for (uint8_t i = 8; i; --i) {
+		data <<= 1;
+
+		// Force SCL low
+		sclLow();
+
+		// Release SDA (from previous ACK)
+		sdaHigh();
+		delayMicroseconds(_delay_us);
+
+		// Release SCL
+		if (!sclHighAndStretch(timeout))
+			return SoftWire::timedOut;
+		delayMicroseconds(_delay_us);
+
+		// Read clock stretch
+		while (readScl() == LOW)
+			if (timeout.isExpired()) {
+				stop(); // Reset bus
+				return SoftWire::timedOut;
+			}
+
+		if (readSda())
+			data |= 1;
+	}
+
+
+	// Put ACK/NACK
+
+	// Force SCL low
+	sclLow();
+	if (sendAck) {
+		// Force SDA low
+		sdaLow();
+	}
+	else {
+		// Release SDA
+		sdaHigh();
+	}
+
+	delayMicroseconds(_delay_us);
+
+	// Release SCL
+	if (!sclHighAndStretch(timeout))
+		return SoftWire::timedOut;
+	delayMicroseconds(_delay_us);
+
+	// Wait for SCL to return high
+	while (readScl() == LOW)
+		if (timeout.isExpired()) {
+			stop(); // Reset bus
+			return SoftWire::timedOut;
+		}
+
+	delayMicroseconds(_delay_us);
+
+	// Keep SCL low between bytes
+	sclLow();
+
+	return SoftWire::ack;
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef SOFTWIRETIMER_H
+#define SOFTWIRETIMER_H
+
+#include <Arduino.h>
+
+// Interface to a periodic timer, used by SoftWireAsync to clock out
+// transfers from a timer interrupt. Implementations configure a hardware
+// timer and call the handler from its interrupt service routine.
+class SoftWireTimer {
+public:
+	typedef void (*handler_t)(void *context);
+
+	// Call handler(context) every period_us microseconds until stop()
+	virtual void start(uint16_t period_us, handler_t handler, void *context) = 0;
+	virtual void stop(void) = 0;
+};
+
+
+// Timer whose handler is called explicitly by fire(). Use it to drive
+// SoftWireAsync from an existing periodic interrupt, or to step through
+// transfers when testing without hardware.
+class SoftWireManualTimer : public SoftWireTimer {
+public:
+	SoftWireManualTimer(void) :
+		_period_us(0),
+		_handler(NULL),
+		_context(NULL) {
+		;
+	}
+
+	virtual void start(uint16_t period_us, handler_t handler, void *context) {
+		_period_us = period_us;
+		_context = context;
+		_handler = handler;
+	}
+
+	virtual void stop(void) {
+		_handler = NULL;
+	}
+
+	inline bool isRunning(void) const {
+		return _handler != NULL;
+	}
+
+	inline uint16_t getPeriod_us(void) const {
+		return _period_us;
+	}
+
+	inline void fire(void) {
+		if (_handler)
+			(*_handler)(_context);
+	}
+
+private:
+	uint16_t _period_us;
+	handler_t volatile _handler;
+	void *_context;
+};
+
+#endif